@@ -0,0 +1,111 @@
+#include "bufferedoutput.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace sgug_rpm {
+
+  buffered_output_file::string_buf::int_type
+  buffered_output_file::string_buf::overflow( int_type c ) {
+    if( !traits_type::eq_int_type( c, traits_type::eof() ) ) {
+      _buffer.push_back( traits_type::to_char_type(c) );
+    }
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize
+  buffered_output_file::string_buf::xsputn( const char * s, std::streamsize n ) {
+    _buffer.append( s, n );
+    return n;
+  }
+
+  buffered_output_file::buffered_output_file( const string & filepath )
+    : std::ostream(NULL),
+      _filepath(filepath),
+      _buf(_buffer) {
+    // Generated files run to a few MB at most
+    _buffer.reserve( 1 << 16 );
+    rdbuf( &_buf );
+  }
+
+  bool buffered_output_file::commit() {
+    return write_temporary() && rename_temporary();
+  }
+
+  bool buffered_output_file::write_temporary() {
+    string tmppath = _filepath + ".tmp";
+    int fd = open( tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if( fd < 0 ) {
+      cerr << "Unable to create " << tmppath << ": " << strerror(errno) << endl;
+      return false;
+    }
+    const char * cur = _buffer.data();
+    size_t len = _buffer.size();
+    bool ok = true;
+    while( ok && len > 0 ) {
+      ssize_t written = ::write( fd, cur, len );
+      if( written < 0 ) {
+	ok = errno == EINTR;
+	continue;
+      }
+      cur += written;
+      len -= written;
+    }
+    // Make sure the contents are down before the rename makes them live
+    ok = ok && fsync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+    if( !ok ) {
+      cerr << "Unable to write " << tmppath << ": " << strerror(errno) << endl;
+      unlink( tmppath.c_str() );
+      return false;
+    }
+    return true;
+  }
+
+  bool buffered_output_file::rename_temporary() {
+    string tmppath = _filepath + ".tmp";
+    if( rename( tmppath.c_str(), _filepath.c_str() ) != 0 ) {
+      cerr << "Unable to write " << _filepath << ": " << strerror(errno) << endl;
+      unlink( tmppath.c_str() );
+      return false;
+    }
+    return true;
+  }
+
+  void buffered_output_file::discard_temporary() {
+    string tmppath = _filepath + ".tmp";
+    unlink( tmppath.c_str() );
+  }
+
+  bool commit_together( const vector<buffered_output_file *> & outputs ) {
+    for( size_t i = 0 ; i < outputs.size() ; ++i ) {
+      if( !outputs[i]->write_temporary() ) {
+	for( size_t written = 0 ; written < i ; ++written ) {
+	  outputs[written]->discard_temporary();
+	}
+	return false;
+      }
+    }
+    bool ok = true;
+    for( buffered_output_file * output : outputs ) {
+      if( ok ) {
+	ok = output->rename_temporary();
+      }
+      else {
+	output->discard_temporary();
+      }
+    }
+    return ok;
+  }
+
+}
@@ -0,0 +1,58 @@
+#ifndef BUFFEREDOUTPUT_HPP
+#define BUFFEREDOUTPUT_HPP
+
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Output stream for generated scripts and lists. Everything written is
+  // gathered in memory (flushes, endl included, don't touch the disk) and
+  // only appears at the destination path when commit() writes it in one
+  // go to a temporary file and renames that into place. An output that
+  // is never committed - say the tool dies half way - leaves any
+  // previous file at the path untouched.
+  class buffered_output_file : public std::ostream {
+  private:
+    class string_buf : public std::streambuf {
+      std::string & _buffer;
+
+    protected:
+      int_type overflow( int_type c ) override;
+      std::streamsize xsputn( const char * s, std::streamsize n ) override;
+
+    public:
+      string_buf( std::string & buffer ) : _buffer(buffer) {}
+    };
+
+    std::string _filepath;
+    std::string _buffer;
+    string_buf _buf;
+
+  public:
+    buffered_output_file( const std::string & filepath );
+    buffered_output_file( const buffered_output_file & ) = delete;
+    buffered_output_file & operator=( const buffered_output_file & ) = delete;
+
+    const std::string & get_filepath() const { return _filepath; };
+
+    bool commit();
+
+    // commit() in its two steps, for outputs that belong together (see
+    // commit_together): the contents written and synced to the temporary
+    // file, then that renamed into place
+    bool write_temporary();
+    bool rename_temporary();
+    void discard_temporary();
+  };
+
+  // Commits outputs as a set. Every temporary file is written and synced
+  // before the first rename, so one that fails leaves all of the previous
+  // files in place. Renames go in the order given.
+  bool commit_together( const std::vector<buffered_output_file *> & outputs );
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "buildmanifest.hpp"
+#include "digest.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using std::ifstream;
+using std::optional;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+using std::filesystem::path;
+
+namespace fs = std::filesystem;
+
+namespace sgug_rpm {
+
+  // Name and contents of every regular file under dir, in sorted
+  // relative path order so the result doesn't depend on readdir order
+  static bool digest_update_dir( digest_h & digest, const string & dir ) {
+    std::error_code ec;
+    vector<path> files;
+    for( fs::recursive_directory_iterator it( dir, ec ), end ;
+	 !ec && it != end ; it.increment(ec) ) {
+      if( it->is_regular_file(ec) ) {
+	files.push_back( it->path().lexically_relative(dir) );
+      }
+    }
+    if( ec ) {
+      return false;
+    }
+    std::sort( files.begin(), files.end() );
+    for( const path & file : files ) {
+      string name = file.string();
+      digest.update( name.c_str(), name.size() + 1 );
+      if( !digest_update_file( digest, (path(dir) / file).string() ) ) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // Whether file sits somewhere below dir
+  static bool path_is_under( const string & file, const string & dir ) {
+    std::error_code ec;
+    path file_p = fs::weakly_canonical( file, ec );
+    if( ec ) {
+      return false;
+    }
+    path dir_p = fs::weakly_canonical( dir, ec );
+    if( ec ) {
+      return false;
+    }
+    path relative = file_p.lexically_relative( dir_p );
+    return !relative.empty() && *relative.begin() != "..";
+  }
+
+  optional<string> compute_spec_input_fingerprint( const string & spec_path,
+						   const string & git_package_dir,
+						   const string & srpm_path ) {
+    digest_h digest;
+    bool have_package_dir = fs::is_directory( git_package_dir );
+    // The spec normally lives in the package dir and is hashed with it
+    if( !have_package_dir || !path_is_under( spec_path, git_package_dir ) ) {
+      if( !digest_update_file( digest, spec_path ) ) {
+	return {};
+      }
+    }
+    if( have_package_dir && !digest_update_dir( digest, git_package_dir ) ) {
+      return {};
+    }
+    if( !srpm_path.empty() ) {
+      std::error_code ec;
+      uintmax_t srpm_size = fs::file_size( srpm_path, ec );
+      if( ec ) {
+	return {};
+      }
+      fs::file_time_type srpm_mtime = fs::last_write_time( srpm_path, ec );
+      if( ec ) {
+	return {};
+      }
+      stringstream srpm_buf;
+      srpm_buf << path(srpm_path).filename().string() << '\0' << srpm_size <<
+	'\0' << srpm_mtime.time_since_epoch().count();
+      digest.update( srpm_buf.str() );
+    }
+    return { digest.final_hex() };
+  }
+
+  void compute_build_fingerprints( const dep_graph & spec_graph,
+				   const vector<string> & input_fingerprints,
+				   vector<string> & build_fingerprints ) {
+    dep_graph_sccs sccs( spec_graph );
+    vector<string> component_fingerprints( sccs.get_num_components() );
+    // Reverse topological numbering - children are always done first
+    for( uint32_t component = 0 ; component < sccs.get_num_components() ; ++component ) {
+      vector<string> parts;
+      bool unknown = false;
+      for( uint32_t member : sccs.get_members(component) ) {
+	unknown = unknown || input_fingerprints[member].empty();
+	parts.push_back( "i" + input_fingerprints[member] );
+	for( uint32_t child : spec_graph.get_edges(member) ) {
+	  uint32_t child_component = sccs.get_component(child);
+	  if( child_component != component ) {
+	    unknown = unknown || component_fingerprints[child_component].empty();
+	    parts.push_back( "d" + component_fingerprints[child_component] );
+	  }
+	}
+      }
+      // An unreadable input anywhere below means "always rebuild"
+      if( unknown ) {
+	continue;
+      }
+      std::sort( parts.begin(), parts.end() );
+      parts.erase( std::unique( parts.begin(), parts.end() ), parts.end() );
+      digest_h digest;
+      for( const string & part : parts ) {
+	digest.update( part.c_str(), part.size() + 1 );
+      }
+      component_fingerprints[component] = digest.final_hex();
+    }
+
+    build_fingerprints.clear();
+    for( uint32_t node = 0 ; node < spec_graph.get_num_nodes() ; ++node ) {
+      build_fingerprints.push_back( component_fingerprints[sccs.get_component(node)] );
+    }
+  }
+
+  bool build_manifest::load( const string & manifestpath ) {
+    _fingerprints.clear();
+    if( !fs::exists( manifestpath ) ) {
+      return true;
+    }
+    ifstream input( manifestpath );
+    if( !input ) {
+      return false;
+    }
+    for( string line; std::getline(input, line); ) {
+      stringstream line_buf( line );
+      string name, fingerprint;
+      if( line_buf >> name >> fingerprint ) {
+	_fingerprints[name] = fingerprint;
+      }
+    }
+    return true;
+  }
+
+  optional<string> build_manifest::find_fingerprint( const string & name ) const {
+    auto finder = _fingerprints.find( name );
+    if( finder == _fingerprints.end() ) {
+      return {};
+    }
+    return { finder->second };
+  }
+
+}
@@ -0,0 +1,48 @@
+#ifndef BUILDMANIFEST_HPP
+#define BUILDMANIFEST_HPP
+
+#include "depgraph.hpp"
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Fingerprint of everything a spec build reads from us: every file
+  // under the package's directory in the git tree, the spec file (read
+  // once, with that directory, when it lives there) and the SRPM. The
+  // SRPM is taken by name, size and mtime - hashing every source
+  // tarball on each run would cost more than the planning saves.
+  // An empty srpm_path leaves the SRPM out.
+  std::optional<std::string> compute_spec_input_fingerprint( const std::string & spec_path,
+							     const std::string & git_package_dir,
+							     const std::string & srpm_path );
+
+  // Folds the fingerprints of everything a spec (transitively) build
+  // requires into its own, so a spec's build fingerprint changes when
+  // its inputs or those of anything beneath it change. Members of a
+  // build dependency cycle share one fingerprint.
+  void compute_build_fingerprints( const dep_graph & spec_graph,
+				   const std::vector<std::string> & input_fingerprints,
+				   std::vector<std::string> & build_fingerprints );
+
+  // Record of the fingerprint each package was last successfully built
+  // with. One "name fingerprint" line per build; worldrebuilder.sh
+  // appends to it, so where a name repeats the last line wins.
+  class build_manifest {
+  private:
+    std::unordered_map<std::string,std::string> _fingerprints;
+
+  public:
+    // A missing manifest is an empty one
+    bool load( const std::string & manifestpath );
+
+    std::optional<std::string> find_fingerprint( const std::string & name ) const;
+    size_t size() const { return _fingerprints.size(); };
+  };
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+#include "buildschedule.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+using std::optional;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::unordered_map;
+using std::vector;
+
+namespace sgug_rpm {
+
+  dep_graph build_spec_graph( const vector<specfile> & specs,
+			      const installed_db_snapshot & installed_db,
+			      vector<string> & unresolved_out )
+  {
+    unordered_map<string,uint32_t> package_to_spec;
+    for( uint32_t idx = 0 ; idx < specs.size() ; ++idx ) {
+      for( const string & pkg : specs[idx].get_packages() ) {
+	package_to_spec.emplace( pkg, idx );
+      }
+    }
+
+    vector<pair<uint32_t,uint32_t>> edge_pairs;
+    for( uint32_t idx = 0 ; idx < specs.size() ; ++idx ) {
+      for( auto & entry : specs[idx].get_build_deps() ) {
+	for( const string & build_dep : entry.second ) {
+	  auto sfind = package_to_spec.find( build_dep );
+	  if( sfind == package_to_spec.end() ) {
+	    // Could be a file or virtual provide - what is providing it now?
+	    optional<pair<string,string> > provider_opt =
+	      installed_db.find_package_providing_file( build_dep );
+	    if( !provider_opt ) {
+	      provider_opt = installed_db.find_package_providing_tag( build_dep );
+	    }
+	    if( provider_opt ) {
+	      sfind = package_to_spec.find( (*provider_opt).first );
+	    }
+	  }
+	  if( sfind == package_to_spec.end() ) {
+	    stringstream unresolved_buf;
+	    unresolved_buf << "Spec " << specs[idx].get_name() <<
+	      " build requires " << build_dep << " which no spec produces";
+	    unresolved_out.push_back( unresolved_buf.str() );
+	    continue;
+	  }
+	  if( sfind->second != idx ) {
+	    edge_pairs.emplace_back( idx, sfind->second );
+	  }
+	}
+      }
+    }
+
+    return dep_graph( specs.size(), edge_pairs );
+  }
+
+  vector<build_group> compute_build_schedule( const vector<specfile> & specs,
+					      const dep_graph & graph )
+  {
+    dep_graph_sccs sccs( graph );
+    vector<uint32_t> component_levels;
+    compute_component_levels( graph, sccs, component_levels );
+
+    vector<build_group> retval;
+    for( uint32_t component = 0 ; component < sccs.get_num_components() ; ++component ) {
+      vector<string> group_specs;
+      for( uint32_t member : sccs.get_members(component) ) {
+	group_specs.push_back( specs[member].get_name() );
+      }
+      std::sort( group_specs.begin(), group_specs.end() );
+      retval.emplace_back( component_levels[component], group_specs );
+    }
+
+    std::sort( retval.begin(), retval.end(),
+	       []( const build_group & a, const build_group & b ) -> bool {
+		 if( a.get_level() == b.get_level() ) {
+		   return a.get_specs() < b.get_specs();
+		 }
+		 else {
+		   return a.get_level() < b.get_level();
+		 }
+	       });
+
+    return retval;
+  }
+
+  vector<build_group> compute_build_schedule( const vector<specfile> & specs,
+					      const installed_db_snapshot & installed_db,
+					      vector<string> & unresolved_out )
+  {
+    dep_graph graph = build_spec_graph( specs, installed_db, unresolved_out );
+    return compute_build_schedule( specs, graph );
+  }
+
+}
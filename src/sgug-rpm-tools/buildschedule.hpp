@@ -0,0 +1,50 @@
+#ifndef BUILDSCHEDULE_HPP
+#define BUILDSCHEDULE_HPP
+
+#include "specfile.hpp"
+#include "installeddb.hpp"
+#include "depgraph.hpp"
+
+#include <string>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // One schedulable unit of a world build. Normally a single spec; specs
+  // whose BuildRequires form a cycle are grouped and must be built one
+  // after the other by the same job.
+  class build_group {
+  private:
+    uint32_t _level;
+    std::vector<std::string> _specs;
+
+  public:
+    build_group( uint32_t level, std::vector<std::string> specs )
+      : _level(level), _specs(specs) {}
+
+    uint32_t get_level() const { return _level; };
+    const std::vector<std::string> & get_specs() const { return _specs; };
+  };
+
+  // The spec -> spec BuildRequires graph, nodes numbered as in specs. A
+  // BuildRequires is mapped to a spec through the sub-packages each spec
+  // produces, falling back to the installed package providing it.
+  // Anything no spec produces is reported in unresolved_out.
+  dep_graph build_spec_graph( const std::vector<specfile> & specs,
+			      const installed_db_snapshot & installed_db,
+			      std::vector<std::string> & unresolved_out );
+
+  // Levels a graph from build_spec_graph: every group in level N only
+  // build requires groups in levels < N, so all groups of a level can be
+  // built concurrently. Specs whose BuildRequires form a cycle share a
+  // group. Groups are returned ordered by level, then name.
+  std::vector<build_group> compute_build_schedule( const std::vector<specfile> & specs,
+						   const dep_graph & spec_graph );
+
+  // Builds the spec graph against installed_db, then schedules it as above
+  std::vector<build_group> compute_build_schedule( const std::vector<specfile> & specs,
+						   const installed_db_snapshot & installed_db,
+						   std::vector<std::string> & unresolved_out );
+}
+
+#endif
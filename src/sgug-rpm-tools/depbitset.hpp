@@ -0,0 +1,57 @@
+#ifndef DEPBITSET_HPP
+#define DEPBITSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Fixed size set of dense ids, 64 to a word
+  class dep_bitset {
+  private:
+    std::vector<uint64_t> _words;
+    size_t _size;
+
+  public:
+    dep_bitset() : _size(0) {}
+    dep_bitset( size_t size ) : _words( (size + 63) / 64, 0 ), _size(size) {}
+
+    size_t size() const { return _size; };
+
+    void set( size_t id ) { _words[id / 64] |= (uint64_t)1 << (id % 64); };
+    bool test( size_t id ) const {
+      return (_words[id / 64] >> (id % 64)) & 1;
+    };
+
+    // Both sets must be the same size
+    void merge( const dep_bitset & other ) {
+      for( size_t i = 0 ; i < _words.size() ; ++i ) {
+	_words[i] |= other._words[i];
+      }
+    };
+
+    size_t count() const {
+      size_t retval = 0;
+      for( uint64_t word : _words ) {
+	retval += __builtin_popcountll(word);
+      }
+      return retval;
+    };
+
+    // Calls fn(id) for each id in the set, in ascending order
+    template<typename Fn>
+    void for_each( Fn fn ) const {
+      for( size_t i = 0 ; i < _words.size() ; ++i ) {
+	uint64_t word = _words[i];
+	while( word != 0 ) {
+	  fn( i * 64 + __builtin_ctzll(word) );
+	  word &= word - 1;
+	}
+      }
+    };
+  };
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include "depclosure.hpp"
+
+#include <algorithm>
+
+using std::pair;
+using std::vector;
+
+namespace sgug_rpm {
+
+  reverse_closure_index::reverse_closure_index( const dep_graph & graph )
+    : _sccs( graph ) {
+    size_t num_components = _sccs.get_num_components();
+    dep_graph requirers = build_component_graph( graph, _sccs ).reversed();
+
+    _component_closures.reserve( num_components );
+    for( size_t component = 0 ; component < num_components ; ++component ) {
+      _component_closures.emplace_back( num_components );
+    }
+    // A requirer always has a higher component number than what it
+    // requires, so walking down means every requirer's row is complete.
+    for( size_t component = num_components ; component-- > 0 ; ) {
+      dep_bitset & closure = _component_closures[component];
+      closure.set( component );
+      for( uint32_t requirer : requirers.get_edges(component) ) {
+	closure.merge( _component_closures[requirer] );
+      }
+    }
+  }
+
+  void reverse_closure_index::query( const vector<uint32_t> & nodes,
+				     vector<uint32_t> & closure_out ) const {
+    closure_out.clear();
+    dep_bitset components( _sccs.get_num_components() );
+    for( uint32_t node : nodes ) {
+      components.merge( _component_closures[_sccs.get_component(node)] );
+    }
+    components.for_each( [&]( size_t component ) {
+			   const vector<uint32_t> & members =
+			     _sccs.get_members(component);
+			   closure_out.insert( closure_out.end(),
+					       members.begin(), members.end() );
+			 });
+    std::sort( closure_out.begin(), closure_out.end() );
+  }
+
+  forward_closure_index::forward_closure_index( const dep_graph & graph )
+    : _sccs( graph ),
+      _components( build_component_graph( graph, _sccs ) ),
+      _component_closures( _sccs.get_num_components() ) {}
+
+  const dep_bitset &
+  forward_closure_index::component_closure( uint32_t component ) {
+    size_t num_components = _sccs.get_num_components();
+    if( _component_closures[component].size() != 0 ) {
+      return _component_closures[component];
+    }
+    // Post-order walk with an explicit stack, require chains can be
+    // thousands of components deep
+    vector<pair<uint32_t,size_t>> stack;
+    stack.emplace_back( component, 0 );
+    while( !stack.empty() ) {
+      uint32_t current = stack.back().first;
+      size_t & next_edge = stack.back().second;
+      edge_range required = _components.get_edges(current);
+      if( next_edge < required.size() ) {
+	uint32_t child = required[next_edge++];
+	if( _component_closures[child].size() == 0 ) {
+	  stack.emplace_back( child, 0 );
+	}
+	continue;
+      }
+      dep_bitset closure( num_components );
+      closure.set( current );
+      for( uint32_t child : required ) {
+	closure.merge( _component_closures[child] );
+      }
+      _component_closures[current] = std::move(closure);
+      stack.pop_back();
+    }
+    return _component_closures[component];
+  }
+
+  dep_bitset
+  forward_closure_index::query_components( const vector<uint32_t> & nodes ) {
+    dep_bitset components( _sccs.get_num_components() );
+    for( uint32_t node : nodes ) {
+      components.merge( component_closure( _sccs.get_component(node) ) );
+    }
+    return components;
+  }
+
+}
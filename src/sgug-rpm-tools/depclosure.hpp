@@ -0,0 +1,60 @@
+#ifndef DEPCLOSURE_HPP
+#define DEPCLOSURE_HPP
+
+#include "depbitset.hpp"
+#include "depgraph.hpp"
+
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Precomputed "what (transitively) requires this" for every node of a
+  // dep_graph, so a closure query is a handful of bitset ORs rather than
+  // a graph walk. Rows are kept per strongly connected component (all
+  // members of a cycle affect each other) and filled in a single pass
+  // over the condensed DAG, requirers first. Memory is one bit per pair
+  // of components, which for a full installed set is a few MB.
+  class reverse_closure_index {
+  private:
+    dep_graph_sccs _sccs;
+    std::vector<dep_bitset> _component_closures;
+
+  public:
+    reverse_closure_index( const dep_graph & graph );
+
+    size_t get_num_components() const { return _sccs.get_num_components(); };
+
+    // Every node that requires any of nodes, directly or indirectly,
+    // including nodes themselves. Returned in ascending node id order.
+    void query( const std::vector<uint32_t> & nodes,
+		std::vector<uint32_t> & closure_out ) const;
+  };
+
+  // The other direction: "what does this (transitively) require". Rows
+  // are only built for components a query reaches and are kept, so
+  // queries over overlapping root sets share everything below their
+  // common parts and a query costs the size of its closure, not the
+  // graph.
+  class forward_closure_index {
+  private:
+    dep_graph_sccs _sccs;
+    dep_graph _components;
+    // Size 0 until the component's closure has been built
+    std::vector<dep_bitset> _component_closures;
+
+    const dep_bitset & component_closure( uint32_t component );
+
+  public:
+    forward_closure_index( const dep_graph & graph );
+
+    const dep_graph_sccs & get_sccs() const { return _sccs; };
+    const dep_graph & get_component_graph() const { return _components; };
+
+    // Components required by any of nodes, directly or indirectly,
+    // including their own
+    dep_bitset query_components( const std::vector<uint32_t> & nodes );
+  };
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include "depdominators.hpp"
+
+using std::pair;
+using std::vector;
+
+namespace sgug_rpm {
+
+  dominator_tree::dominator_tree( const dep_graph & graph, uint32_t root )
+    : _idoms( graph.get_num_nodes(), no_node ) {
+    size_t num_nodes = graph.get_num_nodes();
+    if( root >= num_nodes ) {
+      return;
+    }
+    // Everything below works on DFS numbers; number[node] maps in,
+    // _preorder maps back out
+    vector<uint32_t> number( num_nodes, no_node );
+    vector<uint32_t> parent;
+    vector<pair<uint32_t,size_t>> stack;
+    number[root] = 0;
+    _preorder.push_back( root );
+    parent.push_back( no_node );
+    stack.emplace_back( root, 0 );
+    while( !stack.empty() ) {
+      uint32_t current = stack.back().first;
+      size_t & next_edge = stack.back().second;
+      edge_range required = graph.get_edges(current);
+      if( next_edge == required.size() ) {
+	stack.pop_back();
+	continue;
+      }
+      uint32_t child = required[next_edge++];
+      if( number[child] == no_node ) {
+	number[child] = _preorder.size();
+	_preorder.push_back( child );
+	parent.push_back( number[current] );
+	stack.emplace_back( child, 0 );
+      }
+    }
+
+    size_t num_reached = _preorder.size();
+    dep_graph requirers = graph.reversed();
+    vector<uint32_t> semi( num_reached );
+    vector<uint32_t> label( num_reached );
+    vector<uint32_t> ancestor( num_reached, no_node );
+    vector<uint32_t> idom( num_reached, 0 );
+    vector<vector<uint32_t>> bucket( num_reached );
+    for( uint32_t v = 0 ; v < num_reached ; ++v ) {
+      semi[v] = v;
+      label[v] = v;
+    }
+
+    // The vertex with the smallest semidominator on v's path up the
+    // forest built so far, compressing the path as it goes
+    vector<uint32_t> path;
+    auto eval = [&]( uint32_t v ) -> uint32_t {
+      if( ancestor[v] == no_node ) {
+	return v;
+      }
+      path.clear();
+      for( uint32_t x = v ; ancestor[ancestor[x]] != no_node ; x = ancestor[x] ) {
+	path.push_back( x );
+      }
+      // Top down, so each ancestor is already compressed
+      for( size_t i = path.size() ; i-- > 0 ; ) {
+	uint32_t x = path[i];
+	if( semi[label[ancestor[x]]] < semi[label[x]] ) {
+	  label[x] = label[ancestor[x]];
+	}
+	ancestor[x] = ancestor[ancestor[x]];
+      }
+      return label[v];
+    };
+
+    for( uint32_t w = num_reached ; w-- > 1 ; ) {
+      for( uint32_t requirer : requirers.get_edges(_preorder[w]) ) {
+	uint32_t v = number[requirer];
+	if( v == no_node ) {
+	  continue;
+	}
+	uint32_t u = eval( v );
+	if( semi[u] < semi[w] ) {
+	  semi[w] = semi[u];
+	}
+      }
+      bucket[semi[w]].push_back( w );
+      ancestor[w] = parent[w];
+      for( uint32_t v : bucket[parent[w]] ) {
+	uint32_t u = eval( v );
+	idom[v] = semi[u] < semi[v] ? u : parent[w];
+      }
+      bucket[parent[w]].clear();
+    }
+    for( uint32_t w = 1 ; w < num_reached ; ++w ) {
+      if( idom[w] != semi[w] ) {
+	idom[w] = idom[idom[w]];
+      }
+      _idoms[_preorder[w]] = _preorder[idom[w]];
+    }
+  }
+
+  void dominator_tree::sum_dominated( const vector<uint64_t> & weights,
+				      vector<uint64_t> & sums_out ) const {
+    sums_out.assign( _idoms.size(), 0 );
+    for( uint32_t node : _preorder ) {
+      sums_out[node] = weights[node];
+    }
+    // Dominators come first in preorder, so walking backwards finishes
+    // every node before it is added into its dominator
+    for( size_t i = _preorder.size() ; i-- > 1 ; ) {
+      uint32_t node = _preorder[i];
+      sums_out[_idoms[node]] += sums_out[node];
+    }
+  }
+
+}
@@ -0,0 +1,45 @@
+#ifndef DEPDOMINATORS_HPP
+#define DEPDOMINATORS_HPP
+
+#include "depgraph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Immediate dominators of every node reachable from root, found with
+  // Lengauer-Tarjan (the simple, path compressing variant). Node d
+  // dominates n when every require chain from root to n passes through
+  // d, so the nodes d dominates are exactly what would no longer be
+  // needed if d went. The DFS and the compression are iterative, require
+  // chains can be thousands of nodes deep.
+  class dominator_tree {
+  private:
+    std::vector<uint32_t> _idoms;
+    std::vector<uint32_t> _preorder;
+
+  public:
+    static constexpr uint32_t no_node = UINT32_MAX;
+
+    dominator_tree( const dep_graph & graph, uint32_t root );
+
+    // no_node for root and for nodes root doesn't reach
+    uint32_t get_idom( uint32_t node ) const { return _idoms[node]; };
+    bool is_reachable( uint32_t node ) const {
+      return !_preorder.empty() &&
+	(node == _preorder[0] || _idoms[node] != no_node);
+    };
+    // Reachable nodes in DFS preorder, root first. A node always comes
+    // after its immediate dominator.
+    const std::vector<uint32_t> & get_preorder() const { return _preorder; };
+
+    // For each reachable node, the sum of weights over the nodes it
+    // dominates, itself included. Unreachable nodes get 0.
+    void sum_dominated( const std::vector<uint64_t> & weights,
+			std::vector<uint64_t> & sums_out ) const;
+  };
+
+}
+
+#endif
@@ -1,70 +1,130 @@
 #include <dependencyset.hpp>
+#include "helpers.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_set>
 
 #include <algorithm>
 
 #include <iostream>
 
 using std::string;
+using std::string_view;
 using std::vector;
-using std::unordered_set;
 
 namespace sgug_rpm
 {
-  void rpmds_read_deps( Header package_header,
-			std::vector<std::string> & provides,
-			std::vector<std::string> & requires ) {
-    // Provides
-    rpmds_h rpmds_prov( package_header, RPMTAG_PROVIDENAME, 0);
-    unordered_set<string> prov_set;
-    while( rpmds_prov.next() >= 0 ) {
-      const char * DNEVR;
-      if((DNEVR = rpmdsDNEVR(rpmds_prov.dependency_set)) != NULL) {
-	string prov(DNEVR + 2);
-	if( strncmp(prov.c_str(), "rpmlib(", 7) == 0 ) {
-	  continue;
-	}
-	if( prov_set.find(prov) != prov_set.end() ) {
-	  //		cerr << "Warning: Dupe provide dep on package for " <<
-	  //		  specfile.get_name() << ":" << pkg << ":" <<
-	  //		     prov << endl;
-	}
-	else {
-	  prov_set.insert(prov);
-	}
+  void dep_arena::append( string_view name, uint32_t flags,
+			  string_view evr, dep_form form ) {
+    if( form == dep_form_name ) {
+      // Only rich dependencies have spaces in their name; keep the
+      // first thing they mention
+      size_t firstspace = name.find( ' ' );
+      if( firstspace != string_view::npos ) {
+	name = name.substr( 0, firstspace );
+      }
+      if( !name.empty() && name.front() == '(' && name.back() != ')' ) {
+	name.remove_prefix( 1 );
       }
     }
-    for( const string & s : prov_set ) {
-      provides.push_back(s);
-      //      std::cout << "Found provide: " << s << std::endl;
+    if( (flags & RPMSENSE_RPMLIB) || name.compare( 0, 7, "rpmlib(" ) == 0 ) {
+      return;
+    }
+
+    uint32_t start = _bytes.size();
+    _bytes.append( name );
+    uint32_t name_length = name.size();
+    if( form == dep_form_dnevr ) {
+      if( flags & RPMSENSE_SENSEMASK ) {
+	_bytes += ' ';
+	if( flags & RPMSENSE_LESS ) _bytes += '<';
+	if( flags & RPMSENSE_GREATER ) _bytes += '>';
+	if( flags & RPMSENSE_EQUAL ) _bytes += '=';
+      }
+      if( !evr.empty() ) {
+	_bytes += ' ';
+	_bytes.append( evr );
+      }
+    }
+    _spans.push_back( span{ start, uint32_t(_bytes.size() - start),
+			    name_length } );
+  }
+
+  void dep_arena::sort_unique() {
+    auto span_view = [this]( const span & entry ) {
+      return string_view( _bytes.data() + entry.start, entry.length );
+    };
+    std::sort( _spans.begin(), _spans.end(),
+	       [&]( const span & a, const span & b ) -> bool {
+		 return span_view(a) < span_view(b);
+	       });
+    _spans.erase( std::unique( _spans.begin(), _spans.end(),
+			       [&]( const span & a, const span & b ) -> bool {
+				 return span_view(a) == span_view(b);
+			       }),
+		  _spans.end() );
+  }
+
+  void rpmds_scan_deps( Header package_header, rpmTagVal tagN,
+			dep_form form, dep_arena & arena ) {
+    rpmds_h rpmds_scan( package_header, tagN, 0 );
+    if( !rpmds_scan.dependency_set ) {
+      return;
     }
-    // Requires
-    rpmds_h rpmds_req( package_header, RPMTAG_REQUIRENAME, 0);
-    unordered_set<string> req_set;
-    while( rpmds_req.next() >= 0 ) {
-      const char * DNEVR;
-      if((DNEVR = rpmdsDNEVR(rpmds_req.dependency_set)) != NULL) {
-	string req(DNEVR + 2);
-	if( strncmp(req.c_str(), "rpmlib(", 7) == 0 ) {
-	  continue;
-	}
-	if( req_set.find(req) != req_set.end() ) {
-	  //		cerr << "Warning: Dupe require dep on package for " <<
-	  //		  specfile.get_name() << ":" << pkg << ":" <<
-	  //		     req << endl;
-	}
-	else {
-	  req_set.insert(req);
-	}
+    while( rpmds_scan.next() >= 0 ) {
+      const char * name = rpmdsN(rpmds_scan.dependency_set);
+      if( name == NULL ) {
+	continue;
       }
+      const char * evr = rpmdsEVR(rpmds_scan.dependency_set);
+      arena.append( name, rpmdsFlags(rpmds_scan.dependency_set),
+		    evr != NULL ? evr : "", form );
     }
-    for( const string & s : req_set ) {
-      requires.push_back(s);
-      //      std::cout << "Found require: " << s << std::endl;
+  }
+
+  static void append_unique( dep_arena & arena,
+			     vector<string> & dest ) {
+    arena.sort_unique();
+    dest.reserve( dest.size() + arena.size() );
+    for( size_t i = 0 ; i < arena.size() ; ++i ) {
+      dest.emplace_back( arena.get(i) );
     }
   }
 
+  void rpmds_read_requires( Header package_header,
+			    std::vector<std::string> & requires,
+			    dep_arena * arena ) {
+    dep_arena local_arena;
+    dep_arena & scan_arena = arena != NULL ? *arena : local_arena;
+    scan_arena.clear();
+    rpmds_scan_deps( package_header, RPMTAG_REQUIRENAME, dep_form_name,
+		     scan_arena );
+    append_unique( scan_arena, requires );
+  }
+
+  void rpmds_read_provides( Header package_header,
+			    std::vector<std::string> & provides,
+			    dep_arena * arena ) {
+    dep_arena local_arena;
+    dep_arena & scan_arena = arena != NULL ? *arena : local_arena;
+    scan_arena.clear();
+    rpmds_scan_deps( package_header, RPMTAG_PROVIDENAME, dep_form_dnevr,
+		     scan_arena );
+    append_unique( scan_arena, provides );
+  }
+
+  void rpmds_read_deps( Header package_header,
+			std::vector<std::string> & provides,
+			std::vector<std::string> & requires,
+			dep_arena * arena ) {
+    dep_arena local_arena;
+    dep_arena & scan_arena = arena != NULL ? *arena : local_arena;
+    rpmds_read_provides( package_header, provides, &scan_arena );
+    scan_arena.clear();
+    rpmds_scan_deps( package_header, RPMTAG_REQUIRENAME, dep_form_dnevr,
+		     scan_arena );
+    append_unique( scan_arena, requires );
+  }
+
 }
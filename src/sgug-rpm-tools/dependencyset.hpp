@@ -5,8 +5,11 @@
 #include <rpm/rpmds.h>
 #include <rpm/rpmts.h>
 
-#include <vector>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace sgug_rpm {
 
@@ -25,9 +28,82 @@ namespace sgug_rpm {
     }
   };
 
+  // How each dependency is reduced on its way into a dep_arena
+  enum dep_form {
+    // Versioning stripped, a leading rich dependency bracket dropped
+    dep_form_name,
+    // "name op evr", as rpmdsDNEVR() gives it minus the "R "/"P " prefix
+    dep_form_dnevr
+  };
+
+  // The dependency strings of one scan packed end to end in a single
+  // buffer. Clearing keeps the capacity, so an arena reused for every
+  // header of an rpmdb walk stops growing once it has reached the
+  // largest package. Reading the arena directly allocates nothing; the
+  // rpmds_read_* functions below still copy each entry out into its
+  // own std::string.
+  class dep_arena {
+  private:
+    struct span {
+      uint32_t start;
+      uint32_t length;
+      // Just the name, without any " op evr" a dnevr entry carries
+      uint32_t name_length;
+    };
+    std::string _bytes;
+    std::vector<span> _spans;
+
+  public:
+    void clear() { _bytes.clear(); _spans.clear(); };
+
+    // rpmlib() dependencies are dropped here, by flag or by name
+    void append( std::string_view name,
+		 uint32_t flags,
+		 std::string_view evr,
+		 dep_form form );
+
+    // Sorts the strings, dropping duplicates, in place
+    void sort_unique();
+
+    size_t size() const { return _spans.size(); };
+    // Points into the arena, only good until it next changes
+    std::string_view get( size_t i ) const {
+      return std::string_view( _bytes.data() + _spans[i].start,
+			       _spans[i].length );
+    };
+    std::string_view get_name( size_t i ) const {
+      return std::string_view( _bytes.data() + _spans[i].start,
+			       _spans[i].name_length );
+    };
+  };
+
+  // Appends the tagN dependencies of package_header to arena. Reads
+  // rpmdsN()/rpmdsFlags()/rpmdsEVR() as they are rather than having a
+  // DNEVR string formatted for each one.
+  void rpmds_scan_deps( Header package_header,
+			rpmTagVal tagN,
+			dep_form form,
+			dep_arena & arena );
+
+  // Requires reduced to a bare name: versioning stripped, a leading rich
+  // dependency bracket dropped, rpmlib() requires skipped, duplicates
+  // removed. Pass an arena to reuse it across many headers; each
+  // require appended is still one std::string.
+  void rpmds_read_requires( Header package_header,
+			    std::vector<std::string> & requires,
+			    dep_arena * arena = NULL );
+
+  // Provides as "name op evr", rpmlib() ones skipped, duplicates removed
+  void rpmds_read_provides( Header package_header,
+			    std::vector<std::string> & provides,
+			    dep_arena * arena = NULL );
+
+  // Provides and requires as "name op evr", rpmlib() ones skipped,
+  // duplicates removed
   void rpmds_read_deps( Header package_header,
 			std::vector<std::string> & provides,
-			std::vector<std::string> & requires );
+			std::vector<std::string> & requires,
+			dep_arena * arena = NULL );
 
 }
 
@@ -0,0 +1,237 @@
+#include "depgraph.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+
+using std::atomic;
+using std::pair;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+namespace sgug_rpm {
+
+  static const uint32_t unvisited = std::numeric_limits<uint32_t>::max();
+
+  // Below these sizes thread start-up costs more than it saves
+  static const size_t min_parallel_components = 4096;
+  static const size_t min_parallel_frontier = 1024;
+
+  dep_graph::dep_graph( size_t num_nodes,
+			vector<pair<uint32_t,uint32_t>> & edge_pairs )
+    : _offsets( num_nodes + 1, 0 ) {
+    std::sort( edge_pairs.begin(), edge_pairs.end() );
+    edge_pairs.erase( std::unique( edge_pairs.begin(), edge_pairs.end() ),
+		      edge_pairs.end() );
+    _edges.reserve( edge_pairs.size() );
+    for( auto & edge : edge_pairs ) {
+      _offsets[edge.first + 1]++;
+      _edges.push_back( edge.second );
+    }
+    for( size_t node = 0 ; node < num_nodes ; ++node ) {
+      _offsets[node + 1] += _offsets[node];
+    }
+  }
+
+  dep_graph dep_graph::reversed() const {
+    vector<pair<uint32_t,uint32_t>> edge_pairs;
+    edge_pairs.reserve( _edges.size() );
+    for( uint32_t node = 0 ; node < get_num_nodes() ; ++node ) {
+      for( uint32_t child : get_edges(node) ) {
+	edge_pairs.emplace_back( child, node );
+      }
+    }
+    return dep_graph( get_num_nodes(), edge_pairs );
+  }
+
+  dep_graph_sccs::dep_graph_sccs( const dep_graph & graph )
+    : _node_to_component( graph.get_num_nodes(), unvisited ) {
+    struct frame {
+      uint32_t node;
+      uint32_t next_edge;
+    };
+
+    size_t num_nodes = graph.get_num_nodes();
+    vector<uint32_t> index( num_nodes, unvisited );
+    vector<uint32_t> lowlink( num_nodes, 0 );
+    vector<bool> on_stack( num_nodes, false );
+    vector<uint32_t> scc_stack;
+    vector<frame> call_stack;
+    uint32_t next_index = 0;
+
+    for( uint32_t root = 0 ; root < num_nodes ; ++root ) {
+      if( index[root] != unvisited ) {
+	continue;
+      }
+      index[root] = lowlink[root] = next_index++;
+      scc_stack.push_back(root);
+      on_stack[root] = true;
+      call_stack.push_back( frame{root, 0} );
+
+      while( !call_stack.empty() ) {
+	frame & top = call_stack.back();
+	uint32_t node = top.node;
+	edge_range edges = graph.get_edges(node);
+
+	if( top.next_edge < edges.size() ) {
+	  uint32_t child = edges[top.next_edge++];
+	  if( index[child] == unvisited ) {
+	    index[child] = lowlink[child] = next_index++;
+	    scc_stack.push_back(child);
+	    on_stack[child] = true;
+	    // May reallocate - top is not used again this iteration
+	    call_stack.push_back( frame{child, 0} );
+	  }
+	  else if( on_stack[child] ) {
+	    lowlink[node] = std::min( lowlink[node], index[child] );
+	  }
+	  continue;
+	}
+
+	// All children done - is node the root of a component?
+	if( lowlink[node] == index[node] ) {
+	  uint32_t component = _components.size();
+	  vector<uint32_t> members;
+	  uint32_t member;
+	  do {
+	    member = scc_stack.back();
+	    scc_stack.pop_back();
+	    on_stack[member] = false;
+	    _node_to_component[member] = component;
+	    members.push_back(member);
+	  } while( member != node );
+	  std::sort( members.begin(), members.end() );
+	  _components.emplace_back( std::move(members) );
+	}
+
+	call_stack.pop_back();
+	if( !call_stack.empty() ) {
+	  uint32_t parent = call_stack.back().node;
+	  lowlink[parent] = std::min( lowlink[parent], lowlink[node] );
+	}
+      }
+    }
+  }
+
+  void compute_component_levels( const dep_graph & graph,
+				 const dep_graph_sccs & sccs,
+				 vector<uint32_t> & component_levels ) {
+    size_t num_components = sccs.get_num_components();
+    component_levels.assign( num_components, 0 );
+    // Reverse topological numbering means every component we point at
+    // already has its final level by the time we get to it.
+    for( uint32_t component = 0 ; component < num_components ; ++component ) {
+      uint32_t level = 0;
+      for( uint32_t member : sccs.get_members(component) ) {
+	for( uint32_t child : graph.get_edges(member) ) {
+	  uint32_t child_component = sccs.get_component(child);
+	  if( child_component != component ) {
+	    level = std::max( level, component_levels[child_component] + 1 );
+	  }
+	}
+      }
+      component_levels[component] = level;
+    }
+  }
+
+  dep_graph build_component_graph( const dep_graph & graph,
+				   const dep_graph_sccs & sccs ) {
+    vector<pair<uint32_t,uint32_t>> edge_pairs;
+    for( uint32_t node = 0 ; node < graph.get_num_nodes() ; ++node ) {
+      uint32_t component = sccs.get_component(node);
+      for( uint32_t child : graph.get_edges(node) ) {
+	uint32_t child_component = sccs.get_component(child);
+	if( child_component != component ) {
+	  edge_pairs.emplace_back( component, child_component );
+	}
+      }
+    }
+    return dep_graph( sccs.get_num_components(), edge_pairs );
+  }
+
+  // Process frontier[first, last): release any requirer whose last
+  // outstanding require this was into next_frontier
+  static void release_requirers( const dep_graph & requirers,
+				 const vector<uint32_t> & frontier,
+				 size_t first, size_t last,
+				 atomic<uint32_t> * pending,
+				 vector<uint32_t> & next_frontier ) {
+    for( size_t i = first ; i < last ; ++i ) {
+      for( uint32_t requirer : requirers.get_edges(frontier[i]) ) {
+	if( pending[requirer].fetch_sub(1, std::memory_order_acq_rel) == 1 ) {
+	  next_frontier.push_back(requirer);
+	}
+      }
+    }
+  }
+
+  void compute_component_levels( const dep_graph & graph,
+				 const dep_graph_sccs & sccs,
+				 unsigned int jobs,
+				 vector<uint32_t> & component_levels ) {
+    size_t num_components = sccs.get_num_components();
+    if( jobs <= 1 || num_components < min_parallel_components ) {
+      compute_component_levels( graph, sccs, component_levels );
+      return;
+    }
+
+    dep_graph condensed = build_component_graph( graph, sccs );
+    dep_graph requirers = condensed.reversed();
+
+    unique_ptr<atomic<uint32_t>[]> pending( new atomic<uint32_t>[num_components] );
+    vector<uint32_t> frontier;
+    for( uint32_t component = 0 ; component < num_components ; ++component ) {
+      uint32_t num_requires = condensed.get_edges(component).size();
+      pending[component].store( num_requires, std::memory_order_relaxed );
+      if( num_requires == 0 ) {
+	frontier.push_back(component);
+      }
+    }
+
+    component_levels.assign( num_components, 0 );
+    vector<vector<uint32_t>> next_frontiers( jobs );
+    for( uint32_t level = 0 ; !frontier.empty() ; ++level ) {
+      for( uint32_t component : frontier ) {
+	component_levels[component] = level;
+      }
+
+      size_t num_workers = 1;
+      if( frontier.size() >= min_parallel_frontier ) {
+	num_workers = std::min( (size_t)jobs,
+				frontier.size() / min_parallel_frontier + 1 );
+      }
+      size_t chunk = (frontier.size() + num_workers - 1) / num_workers;
+
+      vector<thread> workers;
+      for( size_t w = 0 ; w < num_workers ; ++w ) {
+	next_frontiers[w].clear();
+	size_t first = std::min( w * chunk, frontier.size() );
+	size_t last = std::min( first + chunk, frontier.size() );
+	if( w == 0 ) {
+	  continue;
+	}
+	workers.emplace_back( release_requirers, std::cref(requirers),
+			      std::cref(frontier), first, last,
+			      pending.get(), std::ref(next_frontiers[w]) );
+      }
+      // The calling thread takes the first chunk itself
+      release_requirers( requirers, frontier, 0,
+			 std::min( chunk, frontier.size() ),
+			 pending.get(), next_frontiers[0] );
+      for( thread & worker : workers ) {
+	worker.join();
+      }
+
+      frontier.clear();
+      for( size_t w = 0 ; w < num_workers ; ++w ) {
+	frontier.insert( frontier.end(), next_frontiers[w].begin(),
+			 next_frontiers[w].end() );
+      }
+    }
+  }
+
+}
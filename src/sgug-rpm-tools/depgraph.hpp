@@ -0,0 +1,100 @@
+#ifndef DEPGRAPH_HPP
+#define DEPGRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Read-only view over one node's slice of the edge array
+  class edge_range {
+  private:
+    const uint32_t * _first;
+    const uint32_t * _last;
+
+  public:
+    edge_range( const uint32_t * first, const uint32_t * last )
+      : _first(first), _last(last) {}
+
+    const uint32_t * begin() const { return _first; };
+    const uint32_t * end() const { return _last; };
+    size_t size() const { return _last - _first; };
+    uint32_t operator[]( size_t i ) const { return _first[i]; };
+  };
+
+  // Directed graph over dense node ids. An edge a -> b means "a requires b".
+  // Stored CSR style: node n's targets are
+  // _edges[_offsets[n] .. _offsets[n+1]), sorted and de-duplicated.
+  class dep_graph {
+  private:
+    std::vector<uint32_t> _offsets;
+    std::vector<uint32_t> _edges;
+
+  public:
+    dep_graph() : _offsets(1, 0) {}
+    // Consumes (from, to) pairs in any order
+    dep_graph( size_t num_nodes,
+	       std::vector<std::pair<uint32_t,uint32_t>> & edge_pairs );
+
+    // Adopts CSR arrays as produced by get_offsets()/get_edge_array()
+    dep_graph( std::vector<uint32_t> offsets, std::vector<uint32_t> edges )
+      : _offsets(std::move(offsets)), _edges(std::move(edges)) {}
+
+    size_t get_num_nodes() const { return _offsets.size() - 1; };
+    size_t get_num_edges() const { return _edges.size(); };
+    edge_range get_edges( uint32_t node ) const {
+      return edge_range( _edges.data() + _offsets[node],
+			 _edges.data() + _offsets[node + 1] );
+    };
+
+    const std::vector<uint32_t> & get_offsets() const { return _offsets; };
+    const std::vector<uint32_t> & get_edge_array() const { return _edges; };
+
+    // Same nodes with every edge flipped (b -> a for a -> b)
+    dep_graph reversed() const;
+  };
+
+  // Strongly connected components computed with an iterative Tarjan walk
+  // (no recursion, so no stack depth limit on long require chains).
+  // Components are numbered in reverse topological order: any edge
+  // leaving component c points at a component < c.
+  class dep_graph_sccs {
+  private:
+    std::vector<uint32_t> _node_to_component;
+    std::vector<std::vector<uint32_t>> _components;
+
+  public:
+    dep_graph_sccs( const dep_graph & graph );
+
+    size_t get_num_components() const { return _components.size(); };
+    uint32_t get_component( uint32_t node ) const { return _node_to_component[node]; };
+    // Members are in ascending node id order
+    const std::vector<uint32_t> & get_members( uint32_t component ) const { return _components[component]; };
+  };
+
+  // The condensed DAG: one node per component, an edge wherever any
+  // member of one component requires a member of another.
+  dep_graph build_component_graph( const dep_graph & graph,
+				   const dep_graph_sccs & sccs );
+
+  // Longest path (counted in components) from each component down to a
+  // component with no requires. All members of a cycle share a level.
+  void compute_component_levels( const dep_graph & graph,
+				 const dep_graph_sccs & sccs,
+				 std::vector<uint32_t> & component_levels );
+
+  // As above, but for large graphs the levels are found with a
+  // frontier-by-frontier (Kahn style) walk up from the leaves with each
+  // frontier split across up to jobs threads. A component joins the
+  // frontier once everything it requires has a level, which makes its
+  // level exactly the frontier number - so results are identical to the
+  // serial version whatever the thread count or scheduling.
+  void compute_component_levels( const dep_graph & graph,
+				 const dep_graph_sccs & sccs,
+				 unsigned int jobs,
+				 std::vector<uint32_t> & component_levels );
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "digest.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using std::optional;
+using std::string;
+
+namespace sgug_rpm {
+
+  string digest_h::final_hex() {
+    char * hex = NULL;
+    size_t hexlen = 0;
+    rpmDigestFinal(ctx, (void **)&hex, &hexlen, 1);
+    ctx = NULL;
+    string retval;
+    if( hex != NULL ) {
+      retval = string(hex);
+      free(hex);
+    }
+    return retval;
+  }
+
+  bool digest_update_file( digest_h & digest, const string & path ) {
+    FILE * file = fopen(path.c_str(), "rb");
+    if( file == NULL ) {
+      return false;
+    }
+    char buf[65536];
+    size_t num_read;
+    while( (num_read = fread(buf, 1, sizeof(buf), file)) > 0 ) {
+      digest.update(buf, num_read);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+  }
+
+  optional<string> digest_file( const string & path ) {
+    digest_h digest;
+    if( !digest_update_file( digest, path ) ) {
+      return {};
+    }
+    return { digest.final_hex() };
+  }
+
+}
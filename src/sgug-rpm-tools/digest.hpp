@@ -0,0 +1,45 @@
+#ifndef DIGEST_HPP
+#define DIGEST_HPP
+
+#include <rpm/rpmpgp.h>
+
+#include <string>
+#include <optional>
+
+namespace sgug_rpm {
+
+  // SHA1 via librpm so we don't drag in another crypto dependency
+  class digest_h {
+  public:
+    DIGEST_CTX ctx;
+
+    digest_h() {
+      ctx = rpmDigestInit(PGPHASHALGO_SHA1, RPMDIGEST_NONE);
+    }
+
+    void update( const void * data, size_t len ) {
+      rpmDigestUpdate(ctx, data, len);
+    }
+
+    void update( const std::string & data ) {
+      update( data.data(), data.size() );
+    }
+
+    // Finalises the context; the handle must not be updated afterwards
+    std::string final_hex();
+
+    ~digest_h() {
+      if( ctx != NULL ) {
+	rpmDigestFinal(ctx, NULL, NULL, 0);
+      }
+    }
+  };
+
+  // Feed the full contents of a file into the digest
+  bool digest_update_file( digest_h & digest, const std::string & path );
+
+  std::optional<std::string> digest_file( const std::string & path );
+
+}
+
+#endif
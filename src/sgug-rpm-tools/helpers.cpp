@@ -1,5 +1,8 @@
 #include "helpers.hpp"
+#include "runstats.hpp"
 
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
 
 using std::cout;
@@ -7,6 +10,8 @@ using std::optional;
 using std::string;
 using std::pair;
 
+using std::filesystem::path;
+
 static char indicators[] = {
   '|',
   '/',
@@ -16,7 +21,22 @@ static char indicators[] = {
 
 namespace sgug_rpm {
 
+  string default_cache_path( const string & filename ) {
+    path cache_root;
+    const char * xdg_cache_home = getenv("XDG_CACHE_HOME");
+    if( xdg_cache_home != NULL && *xdg_cache_home != '\0' ) {
+      cache_root = path(xdg_cache_home);
+    }
+    else {
+      const char * home = getenv("HOME");
+      cache_root = path(home != NULL ? home : ".") / ".cache";
+    }
+    return cache_root / "sgug-rpm-tools" / filename;
+  }
+
   optional<pair<string,string> > find_package_providing_file( const string & required ) {
+    static stat_counter rpmdb_queries( "rpmdb queries" );
+    rpmdb_queries.add();
     rpmts_h rpmts_helper;
     rpmtsiter_h iter_h( rpmts_helper, RPMDBI_INSTFILENAMES,
 			required.c_str(), 0 );
@@ -41,6 +61,8 @@ namespace sgug_rpm {
   }
 
   optional<pair<string,string> > find_package_providing_tag( const string & required ) {
+    static stat_counter rpmdb_queries( "rpmdb queries" );
+    rpmdb_queries.add();
     rpmts_h rpmts_helper;
     rpmtsiter_h iter_h( rpmts_helper, RPMDBI_PROVIDENAME,
 			required.c_str(), 0 );
@@ -64,10 +86,13 @@ namespace sgug_rpm {
     return {};
   }
 
-  progress_printer::progress_printer()
-    : prev_value(0) {}
+  progress_printer::progress_printer( bool enabled )
+    : prev_value(0), enabled(enabled) {}
 
   void progress_printer::accept_progress() {
+    if( !enabled ) {
+      return;
+    }
     cout << "\033[1D" << indicators[prev_value];
     cout.flush();
     prev_value = (prev_value + 1) % 4;
@@ -75,6 +100,9 @@ namespace sgug_rpm {
 
   void progress_printer::reset() {
     prev_value = 0;
+    if( !enabled ) {
+      return;
+    }
     cout << "\033[1D";
   }
 }
@@ -76,10 +76,15 @@ namespace sgug_rpm {
   std::optional<std::pair<std::string,std::string> >
   find_package_providing_tag( const std::string & required );
 
+  // $XDG_CACHE_HOME/sgug-rpm-tools/<filename>, falling back to ~/.cache
+  std::string default_cache_path( const std::string & filename );
+
   class progress_printer {
     uint32_t prev_value;
+    bool enabled;
   public:
-    progress_printer();
+    // A disabled printer swallows progress (for timings and daemons)
+    progress_printer( bool enabled = true );
     void accept_progress();
     void reset();
   };
@@ -0,0 +1,191 @@
+#include "installeddb.hpp"
+#include "dependencyset.hpp"
+#include "runstats.hpp"
+
+#include <iostream>
+
+// rpm bits
+#include <rpm/rpmdb.h>
+#include <rpm/rpmds.h>
+#include <rpm/rpmtd.h>
+#include <rpm/rpmts.h>
+
+using std::cout;
+using std::endl;
+using std::optional;
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace sgug_rpm {
+
+  class rpmtd_h {
+  public:
+    rpmtd td;
+
+    rpmtd_h() {
+      td = rpmtdNew();
+    }
+
+    ~rpmtd_h() {
+      rpmtdFreeData(td);
+      td = rpmtdFree(td);
+    }
+  };
+
+  // Straight off the tag data into the index, no copy of a path beyond
+  // its key
+  static void index_file_names( Header installed_header, size_t idx,
+				unordered_map<string,size_t> & file_index ) {
+    rpmtd_h td_h;
+    if( !headerGet(installed_header, RPMTAG_FILENAMES, td_h.td, HEADERGET_EXT) ) {
+      return;
+    }
+    const char * filename;
+    while( (filename = rpmtdNextString(td_h.td)) != NULL ) {
+      file_index.emplace( filename, idx );
+    }
+  }
+
+  void installed_db_snapshot::load( const bool verbose,
+				    progress_printer & pprinter ) {
+    static stat_phase load_phase( "rpmdb load" );
+    static stat_counter rpmdb_queries( "rpmdb queries" );
+    static stat_counter packages_read( "installed packages read" );
+    scoped_timer timer( load_phase );
+    rpmdb_queries.add();
+    rpmts_h rpmts_helper;
+    rpmtsiter_h iter_h( rpmts_helper, RPMDBI_PACKAGES, NULL, 0 );
+
+    Header installed_header;
+    dep_arena arena;
+    // The provides scan read_installedrpm_header already does, kept so
+    // their names can be indexed without another rpmds pass
+    dep_arena provide_arena;
+    while( (installed_header = iter_h.next()) != NULL ) {
+      installedrpm package;
+      read_installedrpm_header( verbose, installed_header, package,
+				&arena, &provide_arena );
+      size_t idx = add_package_entry( package );
+      for( size_t i = 0 ; i < provide_arena.size() ; ++i ) {
+	_provide_index.emplace( provide_arena.get_name(i), idx );
+      }
+      index_file_names( installed_header, idx, _file_index );
+      packages_read.add();
+      pprinter.accept_progress();
+    }
+    pprinter.reset();
+  }
+
+  size_t installed_db_snapshot::add_package_entry( const installedrpm & package ) {
+    size_t idx = _packages.size();
+    _packages.push_back( package );
+    _packages.back().set_db_index( idx );
+    // Multiple installs of a name: last one wins, as with read_installedrpm
+    _name_index[package.get_name()] = idx;
+
+    interned_package ids;
+    ids.name = _strings.intern( package.get_name() );
+    ids.requires.reserve( package.get_requires().size() );
+    for( const string & require : package.get_requires() ) {
+      ids.requires.push_back( _strings.intern( require ) );
+    }
+    ids.provides.reserve( package.get_provides().size() );
+    for( const string & provide : package.get_provides() ) {
+      ids.provides.push_back( _strings.intern( provide ) );
+    }
+    _interned.push_back( std::move(ids) );
+    return idx;
+  }
+
+  const interned_package *
+  installed_db_snapshot::find_interned( const installedrpm & package ) const {
+    uint32_t idx = package.get_db_index();
+    if( idx >= _packages.size() ) {
+      return NULL;
+    }
+    // Copies carry the index of the entry they came from; name and rpm
+    // file catch a package that came from another snapshot
+    const installedrpm & ours = _packages[idx];
+    if( ours.get_rpmfile() != package.get_rpmfile() ||
+	ours.get_name() != package.get_name() ) {
+      return NULL;
+    }
+    return &_interned[idx];
+  }
+
+  void installed_db_snapshot::add_package( const installedrpm & package,
+					   const vector<string> & provide_names,
+					   const vector<string> & files ) {
+    size_t idx = add_package_entry( package );
+    // Provides/files: first one wins, as with the rpmdb iterator lookups
+    for( const string & provide_name : provide_names ) {
+      _provide_index.emplace( provide_name, idx );
+    }
+    for( const string & file : files ) {
+      _file_index.emplace( file, idx );
+    }
+  }
+
+  void installed_db_snapshot::add_provide_entry( const string & provide_name,
+						 size_t idx ) {
+    _provide_index.emplace( provide_name, idx );
+  }
+
+  void installed_db_snapshot::add_file_entry( const string & file,
+					      size_t idx ) {
+    _file_index.emplace( file, idx );
+  }
+
+  bool installed_db_snapshot::find_package( const string & packagename,
+					    installedrpm & dest ) const {
+    auto finder = _name_index.find( packagename );
+    if( finder == _name_index.end() ) {
+      return false;
+    }
+    dest = _packages[finder->second];
+    return true;
+  }
+
+  optional<pair<string,string> >
+  installed_db_snapshot::find_package_providing_file( const string & required ) const {
+    static stat_counter lookups( "file provider lookups" );
+    lookups.add();
+    auto finder = _file_index.find( required );
+    if( finder == _file_index.end() ) {
+      return {};
+    }
+    const installedrpm & package = _packages[finder->second];
+    return { pair(package.get_name(), package.get_rpmfile()) };
+  }
+
+  optional<pair<string,string> >
+  installed_db_snapshot::find_package_providing_tag( const string & required ) const {
+    static stat_counter lookups( "tag provider lookups" );
+    lookups.add();
+    auto finder = _provide_index.find( required );
+    if( finder == _provide_index.end() ) {
+      return {};
+    }
+    const installedrpm & package = _packages[finder->second];
+    return { pair(package.get_name(), package.get_rpmfile()) };
+  }
+
+  void read_installedrpms( const installed_db_snapshot & snapshot,
+			   const vector<string> & names,
+			   vector<installedrpm> & out_instrpms,
+			   vector<string> & error_instrpms )
+  {
+    for( const string & name : names ) {
+      installedrpm one_instrpm;
+      if( snapshot.find_package( name, one_instrpm ) ) {
+	out_instrpms.emplace_back( one_instrpm );
+      }
+      else {
+	error_instrpms.push_back(name);
+      }
+    }
+  }
+
+}
@@ -0,0 +1,84 @@
+#ifndef INSTALLEDDB_HPP
+#define INSTALLEDDB_HPP
+
+#include "helpers.hpp"
+#include "installedrpm.hpp"
+#include "stringinterner.hpp"
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <unordered_map>
+
+namespace sgug_rpm {
+
+  // A package's name, requires and provides as ids in the string table
+  // of the snapshot holding it
+  struct interned_package {
+    uint32_t name;
+    std::vector<uint32_t> requires;
+    std::vector<uint32_t> provides;
+  };
+
+  // Everything we need from the rpmdb, read in a single walk over
+  // RPMDBI_PACKAGES, with in-memory indexes standing in for the
+  // name / providename / instfilenames rpmdb lookups.
+  class installed_db_snapshot {
+  private:
+    std::vector<installedrpm> _packages;
+
+    std::unordered_map<std::string,size_t> _name_index;
+    std::unordered_map<std::string,size_t> _provide_index;
+    std::unordered_map<std::string,size_t> _file_index;
+
+    // Interned as the packages are added, so each graph build over them
+    // starts from ids rather than hashing every string again
+    string_interner _strings;
+    std::vector<interned_package> _interned;
+
+    // Adds the package and its name; returns its index
+    size_t add_package_entry( const installedrpm & package );
+
+  public:
+    installed_db_snapshot() {};
+
+    void load( const bool verbose, progress_printer & pprinter );
+
+    // Provides are indexed on their name (no version), file paths as is
+    void add_package( const installedrpm & package,
+		      const std::vector<std::string> & provide_names,
+		      const std::vector<std::string> & files );
+
+    // Index entries straight from a previously built snapshot (see
+    // installeddbcache). Entries for an already indexed key are ignored.
+    void add_provide_entry( const std::string & provide_name, size_t idx );
+    void add_file_entry( const std::string & file, size_t idx );
+
+    const std::vector<installedrpm> & get_packages() const { return _packages; };
+    const std::unordered_map<std::string,size_t> & get_provide_index() const { return _provide_index; };
+    const std::unordered_map<std::string,size_t> & get_file_index() const { return _file_index; };
+    size_t get_num_files() const { return _file_index.size(); };
+
+    const string_interner & get_strings() const { return _strings; };
+    // The ids of package when it is (a copy of) one of ours, found by
+    // its db index, else NULL
+    const interned_package * find_interned( const installedrpm & package ) const;
+
+    bool find_package( const std::string & packagename,
+		       installedrpm & dest ) const;
+
+    // Same contract as the rpmdb backed helpers: (name, rpmfile)
+    std::optional<std::pair<std::string,std::string> >
+    find_package_providing_file( const std::string & required ) const;
+    std::optional<std::pair<std::string,std::string> >
+    find_package_providing_tag( const std::string & required ) const;
+  };
+
+  void read_installedrpms( const installed_db_snapshot & snapshot,
+			   const std::vector<std::string> & names,
+			   std::vector<installedrpm> & out_instrpms,
+			   std::vector<std::string> & error_instrpms );
+}
+
+#endif
@@ -0,0 +1,482 @@
+#include "installeddbcache.hpp"
+#include "digest.hpp"
+#include "runstats.hpp"
+#include "serialization.hpp"
+#include "stringinterner.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rpm/rpmmacro.h>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::ofstream;
+using std::pair;
+using std::string;
+using std::string_view;
+using std::stringstream;
+using std::tuple;
+using std::vector;
+
+using std::filesystem::path;
+
+namespace fs = std::filesystem;
+
+static const uint32_t installeddb_cache_magic = 0x42444753; // "SGDB"
+static const uint32_t installeddb_cache_version = 2;
+
+namespace sgug_rpm {
+
+  // Bounds checked walk over the mapping. Every field is a multiple of
+  // 4 bytes long, so id arrays can be handed out in place.
+  class mapped_cursor {
+    const char * _base;
+    size_t _offset;
+    size_t _size;
+
+  public:
+    mapped_cursor( const char * base, size_t offset, size_t size )
+      : _base(base), _offset(offset), _size(size) {}
+
+    size_t get_offset() const { return _offset; };
+
+    bool get_u32( uint32_t & value ) {
+      if( _size - _offset < sizeof(value) ) {
+	return false;
+      }
+      memcpy( &value, _base + _offset, sizeof(value) );
+      _offset += sizeof(value);
+      return true;
+    }
+
+    // Padded out to a 4 byte boundary
+    bool get_bytes( const char *& bytes, size_t len ) {
+      size_t padded_len = (len + 3) & ~(size_t)3;
+      if( _size - _offset < padded_len ) {
+	return false;
+      }
+      bytes = _base + _offset;
+      _offset += padded_len;
+      return true;
+    }
+
+    bool get_u32s( const uint32_t *& values, uint32_t & count ) {
+      const char * bytes;
+      if( !get_u32(count) ||
+	  !get_bytes( bytes, (size_t)count * sizeof(uint32_t) ) ) {
+	return false;
+      }
+      values = reinterpret_cast<const uint32_t *>(bytes);
+      return true;
+    }
+  };
+
+  static void put_padded_bytes( serial_writer & writer,
+				const void * data, size_t len ) {
+    static const char padding[4] = { 0, 0, 0, 0 };
+    writer.put_bytes( data, len );
+    writer.put_bytes( padding, ((len + 3) & ~(size_t)3) - len );
+  }
+
+  static void put_u32s( serial_writer & writer,
+			const vector<uint32_t> & values ) {
+    writer.put_u32( values.size() );
+    writer.put_bytes( values.data(), values.size() * sizeof(uint32_t) );
+  }
+
+  static bool ids_valid( const uint32_t * ids, uint32_t count,
+			 uint32_t limit ) {
+    for( uint32_t i = 0 ; i < count ; ++i ) {
+      if( ids[i] >= limit ) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // Offsets must run from 0 up to last without going backwards
+  static bool offsets_valid( const uint32_t * offsets, uint32_t count,
+			     uint32_t last ) {
+    if( count == 0 || offsets[0] != 0 || offsets[count - 1] != last ) {
+      return false;
+    }
+    for( uint32_t i = 1 ; i < count ; ++i ) {
+      if( offsets[i] < offsets[i - 1] ) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  installed_db_cache::installed_db_cache( string cachepath,
+					  string rpmdb_fingerprint )
+    : _cachepath(cachepath),
+      _rpmdb_fingerprint(rpmdb_fingerprint),
+      _map_base(NULL),
+      _map_size(0),
+      _graph_offset(0) {}
+
+  installed_db_cache::~installed_db_cache() {
+    unmap();
+  }
+
+  void installed_db_cache::unmap() {
+    if( _map_base != NULL ) {
+      munmap( const_cast<char *>(_map_base), _map_size );
+    }
+    _map_base = NULL;
+    _map_size = 0;
+    _graph_offset = 0;
+  }
+
+  bool installed_db_cache::load( installed_db_snapshot & snapshot ) {
+    unmap();
+    int fd = open( _cachepath.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+      return false;
+    }
+    struct stat st;
+    if( fstat(fd, &st) != 0 || st.st_size == 0 ) {
+      close(fd);
+      return false;
+    }
+    void * mapping = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close(fd);
+    if( mapping == MAP_FAILED ) {
+      return false;
+    }
+    _map_base = static_cast<const char *>(mapping);
+    _map_size = st.st_size;
+
+    mapped_cursor cursor( _map_base, 0, _map_size );
+    uint32_t magic, version, fingerprint_len;
+    const char * fingerprint;
+    if( !cursor.get_u32(magic) || magic != installeddb_cache_magic ||
+	!cursor.get_u32(version) || version != installeddb_cache_version ||
+	!cursor.get_u32(fingerprint_len) ||
+	!cursor.get_bytes(fingerprint, fingerprint_len) ||
+	string_view(fingerprint, fingerprint_len) != _rpmdb_fingerprint ) {
+      unmap();
+      return false;
+    }
+
+    uint32_t num_string_offsets, blob_size;
+    const uint32_t * string_offsets;
+    const char * blob;
+    if( !cursor.get_u32s(string_offsets, num_string_offsets) ||
+	!cursor.get_u32(blob_size) ||
+	!cursor.get_bytes(blob, blob_size) ||
+	!offsets_valid(string_offsets, num_string_offsets, blob_size) ) {
+      cerr << "Ignoring damaged installed package cache " << _cachepath << endl;
+      unmap();
+      return false;
+    }
+    uint32_t num_strings = num_string_offsets - 1;
+    vector<string_view> strings;
+    strings.reserve( num_strings );
+    for( uint32_t id = 0 ; id < num_strings ; ++id ) {
+      strings.emplace_back( blob + string_offsets[id],
+			    string_offsets[id + 1] - string_offsets[id] );
+    }
+
+    uint32_t num_packages, num_rpmfiles, num_size_words;
+    uint32_t num_req_offsets, num_reqs, num_prov_offsets, num_provs;
+    uint32_t num_provide_entries, num_file_entries, has_graph;
+    const uint32_t * name_ids;
+    const uint32_t * rpmfile_ids;
+    const uint32_t * size_words;
+    const uint32_t * req_offsets;
+    const uint32_t * req_ids;
+    const uint32_t * prov_offsets;
+    const uint32_t * prov_ids;
+    const uint32_t * provide_entries;
+    const uint32_t * file_entries;
+    if( !cursor.get_u32s(name_ids, num_packages) ||
+	!cursor.get_u32s(rpmfile_ids, num_rpmfiles) ||
+	!cursor.get_u32s(size_words, num_size_words) ||
+	!cursor.get_u32s(req_offsets, num_req_offsets) ||
+	!cursor.get_u32s(req_ids, num_reqs) ||
+	!cursor.get_u32s(prov_offsets, num_prov_offsets) ||
+	!cursor.get_u32s(prov_ids, num_provs) ||
+	!cursor.get_u32s(provide_entries, num_provide_entries) ||
+	!cursor.get_u32s(file_entries, num_file_entries) ||
+	!cursor.get_u32(has_graph) ||
+	num_rpmfiles != num_packages ||
+	num_size_words != 2 * num_packages ||
+	num_req_offsets != num_packages + 1 ||
+	num_prov_offsets != num_packages + 1 ||
+	!offsets_valid(req_offsets, num_req_offsets, num_reqs) ||
+	!offsets_valid(prov_offsets, num_prov_offsets, num_provs) ||
+	!ids_valid(name_ids, num_packages, num_strings) ||
+	!ids_valid(rpmfile_ids, num_packages, num_strings) ||
+	!ids_valid(req_ids, num_reqs, num_strings) ||
+	!ids_valid(prov_ids, num_provs, num_strings) ||
+	num_provide_entries % 2 != 0 || num_file_entries % 2 != 0 ) {
+      cerr << "Ignoring damaged installed package cache " << _cachepath << endl;
+      unmap();
+      return false;
+    }
+
+    installed_db_snapshot loaded;
+    vector<string> no_strings;
+    for( uint32_t idx = 0 ; idx < num_packages ; ++idx ) {
+      vector<string> requires;
+      for( uint32_t i = req_offsets[idx] ; i < req_offsets[idx + 1] ; ++i ) {
+	requires.emplace_back( strings[req_ids[i]] );
+      }
+      vector<string> provides;
+      for( uint32_t i = prov_offsets[idx] ; i < prov_offsets[idx + 1] ; ++i ) {
+	provides.emplace_back( strings[prov_ids[i]] );
+      }
+      uint64_t size = ((uint64_t)size_words[2 * idx] << 32) |
+	size_words[2 * idx + 1];
+      installedrpm package( string(strings[name_ids[idx]]),
+			    string(strings[rpmfile_ids[idx]]),
+			    requires, provides, size );
+      loaded.add_package( package, no_strings, no_strings );
+    }
+    for( uint32_t i = 0 ; i < num_provide_entries ; i += 2 ) {
+      if( provide_entries[i] >= num_strings ||
+	  provide_entries[i + 1] >= num_packages ) {
+	unmap();
+	return false;
+      }
+      loaded.add_provide_entry( string(strings[provide_entries[i]]),
+				provide_entries[i + 1] );
+    }
+    for( uint32_t i = 0 ; i < num_file_entries ; i += 2 ) {
+      if( file_entries[i] >= num_strings ||
+	  file_entries[i + 1] >= num_packages ) {
+	unmap();
+	return false;
+      }
+      loaded.add_file_entry( string(strings[file_entries[i]]),
+			     file_entries[i + 1] );
+    }
+
+    snapshot = std::move(loaded);
+    _graph_offset = has_graph ? cursor.get_offset() : 0;
+    return true;
+  }
+
+  bool installed_db_cache::load_graph( dep_graph & graph,
+				       vector<string> & missing_deps ) const {
+    if( _graph_offset == 0 ) {
+      return false;
+    }
+    mapped_cursor cursor( _map_base, _graph_offset, _map_size );
+    uint32_t num_offsets, num_edges, num_missing_deps;
+    const uint32_t * offsets;
+    const uint32_t * edges;
+    if( !cursor.get_u32s(offsets, num_offsets) ||
+	!cursor.get_u32s(edges, num_edges) ||
+	!offsets_valid(offsets, num_offsets, num_edges) ||
+	!ids_valid(edges, num_edges, num_offsets - 1) ||
+	!cursor.get_u32(num_missing_deps) ) {
+      return false;
+    }
+    vector<string> loaded_missing_deps;
+    for( uint32_t i = 0 ; i < num_missing_deps ; ++i ) {
+      uint32_t len;
+      const char * bytes;
+      if( !cursor.get_u32(len) || !cursor.get_bytes(bytes, len) ) {
+	return false;
+      }
+      loaded_missing_deps.emplace_back( bytes, len );
+    }
+    graph = dep_graph( vector<uint32_t>( offsets, offsets + num_offsets ),
+		       vector<uint32_t>( edges, edges + num_edges ) );
+    missing_deps.swap( loaded_missing_deps );
+    return true;
+  }
+
+  bool installed_db_cache::save( const installed_db_snapshot & snapshot,
+				 const dep_graph * graph,
+				 const vector<string> * missing_deps ) {
+    const vector<installedrpm> & packages = snapshot.get_packages();
+
+    string_interner strings;
+    vector<uint32_t> name_ids, rpmfile_ids, size_words;
+    vector<uint32_t> req_offsets( 1, 0 ), req_ids;
+    vector<uint32_t> prov_offsets( 1, 0 ), prov_ids;
+    for( const installedrpm & package : packages ) {
+      name_ids.push_back( strings.intern( package.get_name() ) );
+      rpmfile_ids.push_back( strings.intern( package.get_rpmfile() ) );
+      // High word first; sizes can pass 4GB
+      size_words.push_back( package.get_size() >> 32 );
+      size_words.push_back( package.get_size() & 0xffffffff );
+      for( const string & require : package.get_requires() ) {
+	req_ids.push_back( strings.intern( require ) );
+      }
+      req_offsets.push_back( req_ids.size() );
+      for( const string & provide : package.get_provides() ) {
+	prov_ids.push_back( strings.intern( provide ) );
+      }
+      prov_offsets.push_back( prov_ids.size() );
+    }
+    // Sorted so the file contents don't depend on hash table order
+    vector<uint32_t> provide_entries, file_entries;
+    vector<pair<uint32_t,uint32_t>> entries;
+    for( auto & entry : snapshot.get_provide_index() ) {
+      entries.emplace_back( strings.intern( entry.first ), entry.second );
+    }
+    std::sort( entries.begin(), entries.end() );
+    for( auto & entry : entries ) {
+      provide_entries.push_back( entry.first );
+      provide_entries.push_back( entry.second );
+    }
+    entries.clear();
+    for( auto & entry : snapshot.get_file_index() ) {
+      entries.emplace_back( strings.intern( entry.first ), entry.second );
+    }
+    std::sort( entries.begin(), entries.end() );
+    for( auto & entry : entries ) {
+      file_entries.push_back( entry.first );
+      file_entries.push_back( entry.second );
+    }
+
+    string contents;
+    serial_writer writer( contents );
+    writer.put_u32( installeddb_cache_magic );
+    writer.put_u32( installeddb_cache_version );
+    writer.put_u32( _rpmdb_fingerprint.size() );
+    put_padded_bytes( writer, _rpmdb_fingerprint.data(),
+		      _rpmdb_fingerprint.size() );
+
+    vector<uint32_t> string_offsets( 1, 0 );
+    string blob;
+    for( uint32_t id = 0 ; id < strings.size() ; ++id ) {
+      blob += strings.get_string(id);
+      string_offsets.push_back( blob.size() );
+    }
+    put_u32s( writer, string_offsets );
+    writer.put_u32( blob.size() );
+    put_padded_bytes( writer, blob.data(), blob.size() );
+
+    put_u32s( writer, name_ids );
+    put_u32s( writer, rpmfile_ids );
+    put_u32s( writer, size_words );
+    put_u32s( writer, req_offsets );
+    put_u32s( writer, req_ids );
+    put_u32s( writer, prov_offsets );
+    put_u32s( writer, prov_ids );
+    put_u32s( writer, provide_entries );
+    put_u32s( writer, file_entries );
+
+    writer.put_u32( graph != NULL ? 1 : 0 );
+    if( graph != NULL ) {
+      put_u32s( writer, graph->get_offsets() );
+      put_u32s( writer, graph->get_edge_array() );
+      uint32_t num_missing_deps = missing_deps != NULL ? missing_deps->size() : 0;
+      writer.put_u32( num_missing_deps );
+      for( uint32_t i = 0 ; i < num_missing_deps ; ++i ) {
+	const string & missing_dep = (*missing_deps)[i];
+	writer.put_u32( missing_dep.size() );
+	put_padded_bytes( writer, missing_dep.data(), missing_dep.size() );
+      }
+    }
+
+    path cache_p = {_cachepath};
+    std::error_code ec;
+    if( cache_p.has_parent_path() ) {
+      fs::create_directories( cache_p.parent_path(), ec );
+    }
+    // Write aside then rename - a reader may have the old one mapped
+    path tmp_p = cache_p;
+    tmp_p += ".tmp";
+    {
+      ofstream output( tmp_p, std::ios::binary | std::ios::trunc );
+      output.write( contents.data(), contents.size() );
+      if( !output ) {
+	cerr << "Failed writing installed package cache " << tmp_p << endl;
+	fs::remove( tmp_p, ec );
+	return false;
+      }
+    }
+    fs::rename( tmp_p, cache_p, ec );
+    if( ec ) {
+      cerr << "Failed renaming installed package cache into place " <<
+	cache_p << endl;
+      return false;
+    }
+    return true;
+  }
+
+  void load_installed_db( package_source & source,
+			  const bool verbose,
+			  installed_db_cache * cache,
+			  installed_db_snapshot & snapshot,
+			  progress_printer & pprinter ) {
+    static stat_counter cache_hits( "installed db cache hits" );
+    static stat_counter cache_misses( "installed db cache misses" );
+    if( cache != NULL && cache->load( snapshot ) ) {
+      cache_hits.add();
+      if( verbose ) {
+	cout << "# Installed packages read from " << cache->get_cachepath() << endl;
+      }
+      return;
+    }
+    if( cache != NULL ) {
+      cache_misses.add();
+    }
+    source.load_installed( verbose, snapshot, pprinter );
+    if( cache != NULL ) {
+      cache->save( snapshot, NULL, NULL );
+    }
+  }
+
+  string default_installed_db_cache_path() {
+    return default_cache_path( "installeddb.bin" );
+  }
+
+  string compute_rpmdb_fingerprint() {
+    digest_h digest;
+    string dbpath;
+    char * expanded = rpmExpand("%{_dbpath}", NULL);
+    if( expanded != NULL ) {
+      dbpath = expanded;
+      free(expanded);
+    }
+    digest.update( dbpath.c_str(), dbpath.size() + 1 );
+
+    // Any rpm transaction rewrites at least one of the database files
+    vector<tuple<string,uintmax_t,int64_t>> db_files;
+    std::error_code ec;
+    for( fs::directory_iterator it( dbpath, ec ), end ;
+	 !ec && it != end ; it.increment(ec) ) {
+      std::error_code stat_ec;
+      if( !it->is_regular_file(stat_ec) ) {
+	continue;
+      }
+      uintmax_t size = it->file_size(stat_ec);
+      fs::file_time_type mtime = it->last_write_time(stat_ec);
+      db_files.emplace_back( it->path().filename().string(), size,
+			     mtime.time_since_epoch().count() );
+    }
+    std::sort( db_files.begin(), db_files.end() );
+    for( auto & db_file : db_files ) {
+      stringstream db_file_buf;
+      db_file_buf << std::get<0>(db_file) << '\0' << std::get<1>(db_file) <<
+	'\0' << std::get<2>(db_file);
+      string db_file_str = db_file_buf.str();
+      digest.update( db_file_str.c_str(), db_file_str.size() + 1 );
+    }
+    return digest.final_hex();
+  }
+
+}
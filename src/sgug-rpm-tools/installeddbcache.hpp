@@ -0,0 +1,74 @@
+#ifndef INSTALLEDDBCACHE_HPP
+#define INSTALLEDDBCACHE_HPP
+
+#include "installeddb.hpp"
+#include "depgraph.hpp"
+#include "packagesource.hpp"
+
+#include <string>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // On-disk copy of an installed_db_snapshot, optionally along with the
+  // package graph over the whole installed set, so later runs can skip
+  // the rpmdb walk. Every string is stored once in a table and referred
+  // to by id; package requires/provides and the graph are CSR arrays of
+  // 32 bit ids. Loading reads the mapped file in a single pass, but
+  // still copies the strings and arrays out into a regular snapshot and
+  // dep_graph (re-indexing the snapshot as it goes) - what it saves is
+  // the rpmdb walk and header decoding, not the rebuild. The file is
+  // keyed on an rpmdb fingerprint and ignored once the rpmdb changes.
+  class installed_db_cache {
+  private:
+    std::string _cachepath;
+    std::string _rpmdb_fingerprint;
+
+    const char * _map_base;
+    size_t _map_size;
+    // Where the (optional) graph section starts, 0 for none
+    size_t _graph_offset;
+
+    void unmap();
+
+  public:
+    installed_db_cache( std::string cachepath,
+			std::string rpmdb_fingerprint );
+    installed_db_cache( const installed_db_cache & ) = delete;
+    installed_db_cache & operator=( const installed_db_cache & ) = delete;
+    ~installed_db_cache();
+
+    const std::string & get_cachepath() const { return _cachepath; };
+
+    // Maps the cache and fills snapshot from a copy of it. False (and
+    // snapshot untouched) when it's missing, stale or damaged.
+    bool load( installed_db_snapshot & snapshot );
+
+    // After a successful load: a copy of the package graph saved with
+    // it. False when there was none.
+    bool load_graph( dep_graph & graph,
+		     std::vector<std::string> & missing_deps ) const;
+
+    // graph/missing_deps are those of build_package_graph over
+    // snapshot.get_packages(), or NULL to save the snapshot alone
+    bool save( const installed_db_snapshot & snapshot,
+	       const dep_graph * graph,
+	       const std::vector<std::string> * missing_deps );
+  };
+
+  // Fill snapshot from cache while it is current, otherwise load it
+  // from source and refresh the cache. A NULL cache always asks source.
+  void load_installed_db( package_source & source,
+			  const bool verbose,
+			  installed_db_cache * cache,
+			  installed_db_snapshot & snapshot,
+			  progress_printer & pprinter );
+
+  // $XDG_CACHE_HOME/sgug-rpm-tools/installeddb.bin, falling back to ~/.cache
+  std::string default_installed_db_cache_path();
+
+  // Changes whenever any file under %{_dbpath} is rewritten
+  std::string compute_rpmdb_fingerprint();
+}
+
+#endif
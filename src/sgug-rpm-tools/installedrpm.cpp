@@ -1,11 +1,12 @@
 #include "installedrpm.hpp"
+#include "installeddb.hpp"
 #include "helpers.hpp"
 #include "dependencyset.hpp"
+#include "runstats.hpp"
 
 #include <iostream>
 #include <filesystem>
 #include <unordered_map>
-#include <unordered_set>
 
 // rpm bits
 #include <rpm/rpmcli.h>
@@ -22,7 +23,6 @@ using std::cerr;
 using std::endl;
 using std::string;
 using std::vector;
-using std::unordered_set;
 using std::unordered_map;
 
 namespace sgug_rpm {
@@ -30,15 +30,55 @@ namespace sgug_rpm {
   installedrpm::installedrpm( string name,
 			      string rpmfile,
 			      vector<string> requires,
-			      vector<string> provides )
-    : _name(name),
-      _rpmfile(rpmfile),
-      _requires(requires),
-      _provides(provides) {}
+			      vector<string> provides,
+			      uint64_t size )
+    : _name(std::move(name)),
+      _rpmfile(std::move(rpmfile)),
+      _requires(std::move(requires)),
+      _provides(std::move(provides)),
+      _size(size) {}
+
+  void read_installedrpm_header( const bool verbose,
+				 Header installed_header,
+				 installedrpm & dest,
+				 dep_arena * arena,
+				 dep_arena * provide_arena )
+  {
+    string packagename(headerGetString(installed_header, RPMTAG_NAME));
+
+    const char * errstr;
+    char * dep_rpmfile_c = headerFormat(installed_header, "%{NAME}-%{VERSION}-%{RELEASE}.%{ARCH}.rpm", &errstr);
+    string packagerpmfile(dep_rpmfile_c);
+    free(dep_rpmfile_c);
+
+    if( verbose ) {
+      cout << "# Checking deps of " << packagename <<
+	" rpm file is " << packagerpmfile << endl;
+    }
+
+    vector<string> provides;
+    rpmds_read_provides( installed_header, provides,
+			 provide_arena != NULL ? provide_arena : arena );
+
+    vector<string> requires;
+    rpmds_read_requires( installed_header, requires, arena );
+
+    uint64_t size = headerGetNumber(installed_header, RPMTAG_LONGSIZE);
+
+    dest = installedrpm( std::move(packagename),
+			 std::move(packagerpmfile),
+			 std::move(requires),
+			 std::move(provides),
+			 size );
+  }
 
   bool read_installedrpm( const bool verbose, const string & packagename,
 			  installedrpm & dest )
   {
+    static stat_phase read_phase( "read_installedrpm" );
+    static stat_counter rpmdb_queries( "rpmdb queries" );
+    scoped_timer timer( read_phase );
+    rpmdb_queries.add();
     sgug_rpm::rpmts_h rpmts_helper;
 
     sgug_rpm::rpmtsiter_h iter_h( rpmts_helper, RPMTAG_NAME,
@@ -49,87 +89,7 @@ namespace sgug_rpm {
     bool found_installed_package = false;
     while( (installed_header = iter_h.next()) != NULL ) {
       found_installed_package = true;
-      installed_header = headerLink(installed_header);
-
-      const char * errstr;
-      char * dep_rpmfile_c = headerFormat(installed_header, "%{NAME}-%{VERSION}-%{RELEASE}.%{ARCH}.rpm", &errstr);
-      string packagerpmfile(dep_rpmfile_c);
-
-      if( verbose ) {
-	cout << "# Checking deps of " << packagename <<
-	  " rpm file is " << packagerpmfile << endl;
-      }
-
-      sgug_rpm::rpmds_h rpmds_prov(installed_header, RPMTAG_PROVIDENAME, 0);
-
-      unordered_set<string> prov_set;
-      if( rpmds_prov.dependency_set ) {
-	while( rpmds_prov.next() >= 0 ) {
-	  const char * DNEVR;
-	  if((DNEVR = rpmdsDNEVR(rpmds_prov.dependency_set)) != NULL) {
-	    string prov(DNEVR + 2);
-	    if( strncmp(prov.c_str(), "rpmlib(", 7) == 0 ) {
-	      continue;
-	    }
-	    if( prov_set.find(prov) != prov_set.end() ) {
-	      //		cerr << "Warning: Dupe provide dep on package for " <<
-	      //		  specfile.get_name() << ":" << pkg << ":" <<
-	      //		     prov << endl;
-	    }
-	    else {
-	      prov_set.insert(prov);
-	    }
-	  }
-	}
-      }
-      vector<string> provides;
-      for( const string & prov : prov_set ) {
-	//	cout << "#  Provide: " << prov << endl;
-	provides.emplace_back(prov);
-      }
-
-      sgug_rpm::rpmds_h rpmds_req(installed_header, RPMTAG_REQUIRENAME, 0);
-
-      unordered_set<string> reqs_set;
-      if( rpmds_req.dependency_set ) {
-	while( rpmds_req.next() >= 0 ) {
-	  const char * DNEVR;
-	  if((DNEVR = rpmdsDNEVR(rpmds_req.dependency_set)) != NULL) {
-	    const char * namestart = DNEVR + 2;
-	    string req(DNEVR + 2);
-	    // Remove any versioning
-	    char * firstspace;
-	    if( (firstspace=strstr(namestart, " ")) != NULL ) {
-	      //	      cout << "Changing require from " << req << endl;
-	      req = req.substr(0,firstspace-namestart);
-	      //	      cout << "It is now " << req << endl;
-	      if( str_starts_with(req,"(") && !str_ends_with(req, ")") ) {
-		req = req.substr(1);
-		//		exit(EXIT_FAILURE);
-	      }
-	    }
-	    if( strncmp(req.c_str(), "rpmlib(", 7) == 0 ) {
-	      continue;
-	    }
-	    if( reqs_set.find(req) != reqs_set.end() ) {
-	      // Duplicate require dep on package - ignore it
-	    }
-	    else {
-	      string short_req(req);
-	      reqs_set.insert(short_req);
-	    }
-	  }
-	}
-      }
-      vector<string> requires;
-      for( const string & req : reqs_set ) {
-	//	cout << "#  Require: " << req << endl;
-	requires.emplace_back(req);	  
-      }
-      dest = installedrpm( packagename,
-			   packagerpmfile,
-			   requires,
-			   provides );
+      read_installedrpm_header( verbose, installed_header, dest );
     }
     return found_installed_package;
   }
@@ -139,15 +99,11 @@ namespace sgug_rpm {
 			   vector<installedrpm> & out_instrpms,
 			   vector<string> & error_instrpms )
   {
-    for( const string & name : names ) {
-      installedrpm one_instrpm;
-      if( read_installedrpm( verbose, name, one_instrpm ) ) {
-	out_instrpms.emplace_back( one_instrpm );
-      }
-      else {
-	error_instrpms.push_back(name);
-      }
-    }
+    // One walk of the rpmdb beats an iterator per name
+    installed_db_snapshot snapshot;
+    progress_printer pprinter;
+    snapshot.load( verbose, pprinter );
+    read_installedrpms( snapshot, names, out_instrpms, error_instrpms );
   }
 
 }
@@ -3,6 +3,7 @@
 
 #include "helpers.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -16,18 +17,43 @@ namespace sgug_rpm {
     std::vector<std::string> _requires;
     std::vector<std::string> _provides;
 
+    // Installed size in bytes (RPMTAG_LONGSIZE)
+    uint64_t _size = 0;
+
+    // Where in the installed_db_snapshot holding it this package (or
+    // the package it was copied from) sits
+    uint32_t _db_index = no_db_index;
+
   public:
+    static const uint32_t no_db_index = UINT32_MAX;
+
     installedrpm() {};
     installedrpm( std::string name,
 		  std::string rpmfile,
 		  std::vector<std::string> requires,
-		  std::vector<std::string> provides);
+		  std::vector<std::string> provides,
+		  uint64_t size = 0 );
     const std::string & get_name() const { return _name; };
     const std::string & get_rpmfile() const { return _rpmfile; };
     const std::vector<std::string> & get_requires() const { return _requires; };
     const std::vector<std::string> & get_provides() const { return _provides; };
+    uint64_t get_size() const { return _size; };
+    uint32_t get_db_index() const { return _db_index; };
+    void set_db_index( uint32_t db_index ) { _db_index = db_index; };
   };
 
+  class dep_arena;
+
+  // Build an installedrpm from an rpmdb header we're iterating over. A
+  // walk over many headers can pass one arena for all of them. Given a
+  // separate provide_arena, the provides are scanned into that and left
+  // there (sorted, see dep_arena::get_name()) for the caller to index.
+  void read_installedrpm_header( const bool verbose,
+				 Header installed_header,
+				 installedrpm & dest,
+				 dep_arena * arena = NULL,
+				 dep_arena * provide_arena = NULL );
+
   bool read_installedrpm( const bool verbose,
 			  const std::string & packagename,
 			  installedrpm & dest );
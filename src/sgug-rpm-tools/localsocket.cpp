@@ -0,0 +1,171 @@
+#include "localsocket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace sgug_rpm {
+
+  static bool fill_sockaddr( const string & socketpath,
+			     struct sockaddr_un & addr ) {
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if( socketpath.size() >= sizeof(addr.sun_path) ) {
+      cerr << "Socket path too long: " << socketpath << endl;
+      return false;
+    }
+    strncpy( addr.sun_path, socketpath.c_str(), sizeof(addr.sun_path) - 1 );
+    return true;
+  }
+
+  line_connection::~line_connection() {
+    if( _fd >= 0 ) {
+      close(_fd);
+    }
+  }
+
+  bool line_connection::read_line( string & line ) {
+    for( ;; ) {
+      size_t newline = _pending.find( '\n' );
+      if( newline != string::npos ) {
+	line = _pending.substr( 0, newline );
+	_pending.erase( 0, newline + 1 );
+	if( !line.empty() && line.back() == '\r' ) {
+	  line.pop_back();
+	}
+	return true;
+      }
+      if( _pending.size() > _max_line_length ) {
+	cerr << "Dropping connection sending an over-long line" << endl;
+	return false;
+      }
+      char buf[4096];
+      ssize_t num_read = read( _fd, buf, sizeof(buf) );
+      if( num_read < 0 ) {
+	if( errno == EINTR && (_stop_flag == NULL || !*_stop_flag) ) {
+	  continue;
+	}
+	// Stopping, timed out or broken - a partial line is no request
+	return false;
+      }
+      if( num_read == 0 ) {
+	// A last line without a newline still counts
+	if( !_pending.empty() ) {
+	  line.swap( _pending );
+	  _pending.clear();
+	  return true;
+	}
+	return false;
+      }
+      _pending.append( buf, num_read );
+    }
+  }
+
+  bool line_connection::set_receive_timeout( unsigned int seconds ) {
+    struct timeval timeout;
+    timeout.tv_sec = seconds;
+    timeout.tv_usec = 0;
+    return setsockopt( _fd, SOL_SOCKET, SO_RCVTIMEO,
+		       &timeout, sizeof(timeout) ) == 0;
+  }
+
+  bool line_connection::set_send_timeout( unsigned int seconds ) {
+    struct timeval timeout;
+    timeout.tv_sec = seconds;
+    timeout.tv_usec = 0;
+    return setsockopt( _fd, SOL_SOCKET, SO_SNDTIMEO,
+		       &timeout, sizeof(timeout) ) == 0;
+  }
+
+  bool line_connection::write_all( const string & data ) {
+    const char * cur = data.data();
+    size_t len = data.size();
+    while( len > 0 ) {
+      ssize_t written = write( _fd, cur, len );
+      if( written < 0 ) {
+	if( errno == EINTR && (_stop_flag == NULL || !*_stop_flag) ) {
+	  continue;
+	}
+	// EAGAIN included: the send timeout ran out
+	return false;
+      }
+      cur += written;
+      len -= written;
+    }
+    return true;
+  }
+
+  unix_socket_listener::unix_socket_listener( const string & socketpath )
+    : _socketpath(socketpath), _fd(-1) {
+    struct sockaddr_un addr;
+    if( !fill_sockaddr( socketpath, addr ) ) {
+      return;
+    }
+    // Only ever remove a socket, never some other file at that path
+    struct stat st;
+    if( lstat( socketpath.c_str(), &st ) == 0 ) {
+      if( !S_ISSOCK(st.st_mode) ) {
+	cerr << "Not replacing non-socket " << socketpath << endl;
+	return;
+      }
+      int probe_fd = connect_unix_socket( socketpath );
+      if( probe_fd >= 0 ) {
+	close(probe_fd);
+	cerr << "A server is already listening on " << socketpath << endl;
+	return;
+      }
+      unlink( socketpath.c_str() );
+    }
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 ) {
+      cerr << "Unable to create socket: " << strerror(errno) << endl;
+      return;
+    }
+    if( bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 ||
+	listen( fd, 16 ) != 0 ) {
+      cerr << "Unable to listen on " << socketpath << ": " <<
+	strerror(errno) << endl;
+      close(fd);
+      return;
+    }
+    _fd = fd;
+  }
+
+  unix_socket_listener::~unix_socket_listener() {
+    if( _fd >= 0 ) {
+      close(_fd);
+      unlink( _socketpath.c_str() );
+    }
+  }
+
+  int unix_socket_listener::accept_client() {
+    return accept( _fd, NULL, NULL );
+  }
+
+  int connect_unix_socket( const string & socketpath ) {
+    struct sockaddr_un addr;
+    if( !fill_sockaddr( socketpath, addr ) ) {
+      return -1;
+    }
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 ) {
+      return -1;
+    }
+    if( connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 ) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+}
@@ -0,0 +1,74 @@
+#ifndef LOCALSOCKET_HPP
+#define LOCALSOCKET_HPP
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sgug_rpm {
+
+  // Line oriented stream over a connected Unix domain socket
+  class line_connection {
+  private:
+    int _fd;
+    std::string _pending;
+    const volatile sig_atomic_t * _stop_flag;
+    size_t _max_line_length;
+
+  public:
+    line_connection( int fd )
+      : _fd(fd), _stop_flag(NULL), _max_line_length(SIZE_MAX) {}
+    line_connection( const line_connection & ) = delete;
+    line_connection & operator=( const line_connection & ) = delete;
+    ~line_connection();
+
+    bool is_valid() const { return _fd >= 0; };
+
+    // A read interrupted by a signal gives up, rather than waiting on,
+    // once the handler has set *stop_flag
+    void set_stop_flag( const volatile sig_atomic_t * stop_flag ) {
+      _stop_flag = stop_flag;
+    };
+    // Reads waiting longer than seconds end the stream
+    bool set_receive_timeout( unsigned int seconds );
+    // Writes blocked longer than seconds (a peer that stopped reading)
+    // fail rather than wait on it
+    bool set_send_timeout( unsigned int seconds );
+    // As does a line growing past max_line_length
+    void set_max_line_length( size_t max_line_length ) {
+      _max_line_length = max_line_length;
+    };
+
+    // Next line without its terminator; false at end of stream, on
+    // error, timeout or stop
+    bool read_line( std::string & line );
+    bool write_all( const std::string & data );
+  };
+
+  // Listening socket bound to a filesystem path. A stale socket left
+  // behind by a previous server is replaced; the path is removed again
+  // when the listener is destroyed.
+  class unix_socket_listener {
+  private:
+    std::string _socketpath;
+    int _fd;
+
+  public:
+    unix_socket_listener( const std::string & socketpath );
+    unix_socket_listener( const unix_socket_listener & ) = delete;
+    unix_socket_listener & operator=( const unix_socket_listener & ) = delete;
+    ~unix_socket_listener();
+
+    bool is_valid() const { return _fd >= 0; };
+
+    // Blocks for the next client. Returns -1 when interrupted by a signal
+    // or on error.
+    int accept_client();
+  };
+
+  // Connect to a listener at socketpath, -1 on failure
+  int connect_unix_socket( const std::string & socketpath );
+}
+
+#endif
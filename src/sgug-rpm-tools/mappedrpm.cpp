@@ -0,0 +1,232 @@
+#include "mappedrpm.hpp"
+#include "dependencyset.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rpm/rpmds.h>
+
+using std::cerr;
+using std::endl;
+using std::optional;
+using std::string;
+using std::string_view;
+using std::vector;
+
+// See standalonerpm.cpp for the overall package layout
+static const size_t rpm_lead_size = 96;
+static const unsigned char rpm_lead_magic[] = { 0xed, 0xab, 0xee, 0xdb };
+static const unsigned char rpm_header_magic[] = { 0x8e, 0xad, 0xe8, 0x01 };
+static const size_t rpm_header_intro_size = 16;
+static const size_t rpm_header_entry_size = 16;
+
+// Header entry data types we decode (rpmTagType values)
+static const uint32_t rpm_int32_type = 4;
+static const uint32_t rpm_string_type = 6;
+static const uint32_t rpm_string_array_type = 8;
+
+static uint32_t read_be32( const unsigned char * p ) {
+  uint32_t value;
+  memcpy( &value, p, sizeof(value) );
+  return ntohl(value);
+}
+
+namespace sgug_rpm {
+
+  mapped_rpm_h::mapped_rpm_h( const string & rpmpath )
+    : _base(NULL), _size(0),
+      _index(NULL), _index_count(0),
+      _data(NULL), _data_size(0) {
+    int fd = open( rpmpath.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+      return;
+    }
+    struct stat st;
+    if( fstat(fd, &st) != 0 || st.st_size < (off_t)rpm_lead_size ) {
+      close(fd);
+      return;
+    }
+    void * mapping = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close(fd);
+    if( mapping == MAP_FAILED ) {
+      return;
+    }
+    _base = static_cast<const unsigned char *>(mapping);
+    _size = st.st_size;
+
+    if( memcmp(_base, rpm_lead_magic, sizeof(rpm_lead_magic)) != 0 ) {
+      return;
+    }
+
+    // Signature header, padded out to 8 bytes, then the main header.
+    // Sizes come from the file, so they're checked in 64 bits against
+    // what's left of the mapping before anything is read; a truncated
+    // or damaged package just leaves the handle invalid.
+    uint64_t offset = rpm_lead_size;
+    for( int header_num = 0 ; header_num < 2 ; ++header_num ) {
+      if( offset > _size || _size - offset < rpm_header_intro_size ||
+	  memcmp(_base + offset, rpm_header_magic, sizeof(rpm_header_magic)) != 0 ) {
+	return;
+      }
+      uint32_t index_count = read_be32( _base + offset + 8 );
+      uint32_t data_size = read_be32( _base + offset + 12 );
+      // Neither term can overflow 64 bits from 32 bit counts
+      uint64_t index_bytes = (uint64_t)index_count * rpm_header_entry_size;
+      uint64_t header_bytes = rpm_header_intro_size + index_bytes + data_size;
+      if( _size - offset < header_bytes ) {
+	return;
+      }
+      if( header_num == 1 ) {
+	_index = _base + offset + rpm_header_intro_size;
+	_index_count = index_count;
+	_data = reinterpret_cast<const char *>(_index + index_bytes);
+	_data_size = data_size;
+      }
+      offset += header_bytes;
+      offset += (8 - (header_bytes % 8)) % 8;
+    }
+  }
+
+  mapped_rpm_h::~mapped_rpm_h() {
+    if( _base != NULL ) {
+      munmap( const_cast<unsigned char *>(_base), _size );
+    }
+  }
+
+  const unsigned char * mapped_rpm_h::find_entry( rpmTagVal tag,
+						  uint32_t type ) const {
+    for( uint32_t i = 0 ; i < _index_count ; ++i ) {
+      const unsigned char * entry = _index + i * rpm_header_entry_size;
+      if( read_be32(entry) == (uint32_t)tag ) {
+	if( read_be32(entry + 4) != type || read_be32(entry + 8) >= _data_size ) {
+	  return NULL;
+	}
+	return entry;
+      }
+    }
+    return NULL;
+  }
+
+  optional<string_view> mapped_rpm_h::get_string( rpmTagVal tag ) const {
+    const unsigned char * entry = find_entry( tag, rpm_string_type );
+    if( entry == NULL ) {
+      return {};
+    }
+    uint32_t offset = read_be32( entry + 8 );
+    const char * start = _data + offset;
+    const void * terminator = memchr( start, '\0', _data_size - offset );
+    if( terminator == NULL ) {
+      return {};
+    }
+    return { string_view( start, static_cast<const char *>(terminator) - start ) };
+  }
+
+  bool mapped_rpm_h::get_string_array( rpmTagVal tag,
+				       vector<string_view> & dest ) const {
+    const unsigned char * entry = find_entry( tag, rpm_string_array_type );
+    if( entry == NULL ) {
+      return false;
+    }
+    uint32_t offset = read_be32( entry + 8 );
+    uint32_t count = read_be32( entry + 12 );
+    dest.reserve( dest.size() + count );
+    for( uint32_t i = 0 ; i < count ; ++i ) {
+      if( offset >= _data_size ) {
+	return false;
+      }
+      const char * start = _data + offset;
+      const void * terminator = memchr( start, '\0', _data_size - offset );
+      if( terminator == NULL ) {
+	return false;
+      }
+      size_t len = static_cast<const char *>(terminator) - start;
+      dest.emplace_back( start, len );
+      offset += len + 1;
+    }
+    return true;
+  }
+
+  bool mapped_rpm_h::get_int32_array( rpmTagVal tag,
+				      vector<uint32_t> & dest ) const {
+    const unsigned char * entry = find_entry( tag, rpm_int32_type );
+    if( entry == NULL ) {
+      return false;
+    }
+    uint32_t offset = read_be32( entry + 8 );
+    uint32_t count = read_be32( entry + 12 );
+    if( ((size_t)_data_size - offset) / sizeof(uint32_t) < count ) {
+      return false;
+    }
+    dest.reserve( dest.size() + count );
+    for( uint32_t i = 0 ; i < count ; ++i ) {
+      dest.push_back( read_be32( reinterpret_cast<const unsigned char *>(_data + offset) + i * sizeof(uint32_t) ) );
+    }
+    return true;
+  }
+
+  // Same strings as rpmds_read_deps() would give for one dependency tag
+  static void read_mapped_deps( const mapped_rpm_h & mapped_rpm,
+				rpmTagVal name_tag,
+				rpmTagVal flags_tag,
+				rpmTagVal version_tag,
+				dep_arena & arena,
+				vector<string> & dest ) {
+    vector<string_view> names;
+    vector<uint32_t> flags;
+    vector<string_view> versions;
+    if( !mapped_rpm.get_string_array( name_tag, names ) ) {
+      return;
+    }
+    mapped_rpm.get_int32_array( flags_tag, flags );
+    mapped_rpm.get_string_array( version_tag, versions );
+
+    arena.clear();
+    for( size_t i = 0 ; i < names.size() ; ++i ) {
+      arena.append( names[i],
+		    i < flags.size() ? flags[i] : 0,
+		    i < versions.size() ? versions[i] : string_view(),
+		    dep_form_dnevr );
+    }
+    arena.sort_unique();
+    for( size_t i = 0 ; i < arena.size() ; ++i ) {
+      dest.emplace_back( arena.get(i) );
+    }
+  }
+
+  bool read_standalonerpm_mapped( const bool verbose,
+				  const string & rpmpath,
+				  standalonerpm & dest,
+				  const bool read_deps )
+  {
+    mapped_rpm_h mapped_rpm( rpmpath );
+    if( !mapped_rpm.is_valid() ) {
+      return false;
+    }
+    optional<string_view> name_opt = mapped_rpm.get_string( RPMTAG_NAME );
+    if( !name_opt ) {
+      return false;
+    }
+
+    vector<string> provides;
+    vector<string> requires;
+    if( read_deps ) {
+      dep_arena arena;
+      read_mapped_deps( mapped_rpm, RPMTAG_PROVIDENAME, RPMTAG_PROVIDEFLAGS,
+			RPMTAG_PROVIDEVERSION, arena, provides );
+      read_mapped_deps( mapped_rpm, RPMTAG_REQUIRENAME, RPMTAG_REQUIREFLAGS,
+			RPMTAG_REQUIREVERSION, arena, requires );
+    }
+
+    dest = { string(*name_opt), rpmpath, std::move(provides),
+	     std::move(requires) };
+
+    return true;
+  }
+
+}
@@ -0,0 +1,53 @@
+#ifndef MAPPEDRPM_HPP
+#define MAPPEDRPM_HPP
+
+#include "standalonerpm.hpp"
+
+#include <rpm/rpmtag.h>
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Read-only mmap of a package file with the main header's tag index
+  // located in place. Nothing is copied or verified; the views handed
+  // out point straight into the mapping and live as long as the handle.
+  // Only the pages holding the lead and headers are ever faulted in.
+  class mapped_rpm_h {
+  private:
+    const unsigned char * _base;
+    size_t _size;
+
+    const unsigned char * _index;
+    uint32_t _index_count;
+    const char * _data;
+    uint32_t _data_size;
+
+    const unsigned char * find_entry( rpmTagVal tag, uint32_t type ) const;
+
+  public:
+    mapped_rpm_h( const std::string & rpmpath );
+    mapped_rpm_h( const mapped_rpm_h & ) = delete;
+    mapped_rpm_h & operator=( const mapped_rpm_h & ) = delete;
+    ~mapped_rpm_h();
+
+    bool is_valid() const { return _index != NULL; };
+
+    std::optional<std::string_view> get_string( rpmTagVal tag ) const;
+    bool get_string_array( rpmTagVal tag,
+			   std::vector<std::string_view> & dest ) const;
+    bool get_int32_array( rpmTagVal tag,
+			  std::vector<uint32_t> & dest ) const;
+  };
+
+  // Same result as read_standalonerpm, decoded from a mapped_rpm_h
+  bool read_standalonerpm_mapped( const bool verbose,
+				  const std::string & rpmpath,
+				  standalonerpm & dest,
+				  const bool read_deps );
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include "packagesource.hpp"
+#include "digest.hpp"
+#include "installeddbcache.hpp"
+#include "runstats.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+using std::cerr;
+using std::endl;
+using std::optional;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+using std::filesystem::path;
+
+namespace fs = std::filesystem;
+
+namespace sgug_rpm {
+
+  string rpmdb_package_source::get_installed_fingerprint() {
+    return compute_rpmdb_fingerprint();
+  }
+
+  void rpmdb_package_source::load_installed( const bool verbose,
+					     installed_db_snapshot & snapshot,
+					     progress_printer & pprinter ) {
+    snapshot.load( verbose, pprinter );
+  }
+
+  optional<string>
+  rpmdb_package_source::find_specfile( const string & gitrootdir,
+				       const string & package_name ) {
+    path package_spec_path = path(gitrootdir) / "packages" / package_name /
+      "SPECS" / (package_name + ".spec");
+    if( fs::exists(package_spec_path) ) {
+      return {fs::canonical(package_spec_path)};
+    }
+    return {};
+  }
+
+  void rpmdb_package_source::read_specfiles( const vector<string> & paths,
+					     rpmSpecFlags flags,
+					     unsigned int jobs,
+					     specfile_cache * cache,
+					     vector<specfile> & out_specfiles,
+					     vector<string> & error_specfiles,
+					     progress_printer & pprinter ) {
+    sgug_rpm::read_specfiles( _popt_context, paths, flags, jobs, cache,
+			      out_specfiles, error_specfiles, pprinter );
+  }
+
+  // Provide DNEVRs look like "name = 1.0-1"; the index wants the name
+  static string provide_name_of( const string & provide ) {
+    size_t space = provide.find( ' ' );
+    return space == string::npos ? provide : provide.substr( 0, space );
+  }
+
+  static vector<string> split_tabs( const string & line ) {
+    vector<string> fields;
+    size_t start = 0;
+    for( ;; ) {
+      size_t tab = line.find( '\t', start );
+      fields.push_back( line.substr( start, tab == string::npos ?
+				     string::npos : tab - start ) );
+      if( tab == string::npos ) {
+	return fields;
+      }
+      start = tab + 1;
+    }
+  }
+
+  // Field lists are collected as the lines arrive, then frozen into the
+  // immutable installedrpm / specfile values at the next record.
+  struct fixture_package_builder {
+    string name;
+    string rpmfile;
+    uint64_t size = 0;
+    vector<string> requires;
+    vector<string> provides;
+    vector<string> provide_names;
+    vector<string> files;
+  };
+
+  struct fixture_spec_builder {
+    string name;
+    string filepath;
+    vector<string> packages;
+    unordered_map<string,vector<string>> build_deps;
+  };
+
+  bool fixture_package_source::load( const string & fixturepath ) {
+    std::ifstream input( fixturepath );
+    if( !input ) {
+      cerr << "Unable to read fixture " << fixturepath << endl;
+      return false;
+    }
+    optional<string> fingerprint_opt = digest_file( fixturepath );
+    _fingerprint = "fixture:" + (fingerprint_opt ? *fingerprint_opt : "");
+    _packages.clear();
+    _specs.clear();
+    _spec_by_name.clear();
+    _spec_by_path.clear();
+
+    optional<fixture_package_builder> cur_package;
+    optional<fixture_spec_builder> cur_spec;
+    auto finish_package = [&]() {
+      if( cur_package ) {
+	fixture_package_builder & b = *cur_package;
+	_packages.push_back( fixture_package{
+	    installedrpm( b.name, b.rpmfile, b.requires, b.provides,
+			  b.size ),
+	    b.provide_names, b.files } );
+	cur_package.reset();
+      }
+    };
+    auto finish_spec = [&]() {
+      if( cur_spec ) {
+	fixture_spec_builder & b = *cur_spec;
+	_spec_by_name.emplace( b.name, _specs.size() );
+	_spec_by_path.emplace( b.filepath, _specs.size() );
+	_specs.emplace_back( b.filepath, b.name, b.packages, b.build_deps );
+	cur_spec.reset();
+      }
+    };
+
+    size_t line_no = 0;
+    for( string line; std::getline(input, line); ) {
+      ++line_no;
+      if( line.empty() || line[0] == '#' ) {
+	continue;
+      }
+      vector<string> fields = split_tabs( line );
+      const string & kind = fields[0];
+      bool ok = true;
+      if( kind == "package" && fields.size() == 3 ) {
+	finish_package();
+	cur_package = fixture_package_builder();
+	cur_package->name = fields[1];
+	cur_package->rpmfile = fields[2];
+	cur_package->provide_names.push_back( fields[1] );
+      }
+      else if( kind == "size" && fields.size() == 2 && cur_package ) {
+	char * end;
+	cur_package->size = strtoull( fields[1].c_str(), &end, 10 );
+	ok = !fields[1].empty() && *end == '\0';
+      }
+      else if( kind == "require" && fields.size() == 2 && cur_package ) {
+	cur_package->requires.push_back( fields[1] );
+      }
+      else if( kind == "provide" && fields.size() == 2 && cur_package ) {
+	cur_package->provides.push_back( fields[1] );
+	cur_package->provide_names.push_back( provide_name_of( fields[1] ) );
+      }
+      else if( kind == "providename" && fields.size() == 2 && cur_package ) {
+	cur_package->provide_names.push_back( fields[1] );
+      }
+      else if( kind == "file" && fields.size() == 2 && cur_package ) {
+	cur_package->files.push_back( fields[1] );
+      }
+      else if( kind == "spec" && fields.size() == 3 ) {
+	finish_spec();
+	cur_spec = fixture_spec_builder();
+	cur_spec->name = fields[1];
+	cur_spec->filepath = fields[2];
+      }
+      else if( kind == "subpackage" && fields.size() == 2 && cur_spec ) {
+	cur_spec->packages.push_back( fields[1] );
+	cur_spec->build_deps.emplace( fields[1], vector<string>() );
+      }
+      else if( kind == "buildrequire" && fields.size() == 3 && cur_spec ) {
+	cur_spec->build_deps[fields[1]].push_back( fields[2] );
+      }
+      else {
+	ok = false;
+      }
+      if( !ok ) {
+	cerr << fixturepath << ":" << line_no << ": bad fixture line: " <<
+	  line << endl;
+	return false;
+      }
+    }
+    finish_package();
+    finish_spec();
+    return true;
+  }
+
+  string fixture_package_source::get_installed_fingerprint() {
+    return _fingerprint;
+  }
+
+  void fixture_package_source::load_installed( const bool verbose,
+					       installed_db_snapshot & snapshot,
+					       progress_printer & pprinter ) {
+    static stat_counter packages_read( "installed packages read" );
+    for( const fixture_package & fixture : _packages ) {
+      snapshot.add_package( fixture.package, fixture.provide_names,
+			    fixture.files );
+    }
+    packages_read.add( _packages.size() );
+  }
+
+  optional<string>
+  fixture_package_source::find_specfile( const string & gitrootdir,
+					 const string & package_name ) {
+    auto finder = _spec_by_name.find( package_name );
+    if( finder == _spec_by_name.end() ) {
+      return {};
+    }
+    return { _specs[finder->second].get_filepath() };
+  }
+
+  void fixture_package_source::read_specfiles( const vector<string> & paths,
+					       rpmSpecFlags flags,
+					       unsigned int jobs,
+					       specfile_cache * cache,
+					       vector<specfile> & out_specfiles,
+					       vector<string> & error_specfiles,
+					       progress_printer & pprinter ) {
+    for( const string & specpath : paths ) {
+      auto finder = _spec_by_path.find( specpath );
+      if( finder == _spec_by_path.end() ) {
+	error_specfiles.push_back( specpath );
+      }
+      else {
+	out_specfiles.push_back( _specs[finder->second] );
+      }
+    }
+  }
+
+  unique_ptr<package_source>
+  open_package_source( poptcontext_h & popt_context,
+		       const char * fixturefile ) {
+    if( fixturefile == NULL ) {
+      return unique_ptr<package_source>(
+	new rpmdb_package_source( popt_context ) );
+    }
+    unique_ptr<fixture_package_source> fixture( new fixture_package_source() );
+    if( !fixture->load( fixturefile ) ) {
+      return {};
+    }
+    return fixture;
+  }
+
+  void write_package_fixture( std::ostream & out,
+			      const installed_db_snapshot & snapshot,
+			      const vector<specfile> & specs ) {
+    const vector<installedrpm> & packages = snapshot.get_packages();
+    vector<vector<string>> provide_names( packages.size() );
+    vector<vector<string>> files( packages.size() );
+    for( auto & entry : snapshot.get_provide_index() ) {
+      provide_names[entry.second].push_back( entry.first );
+    }
+    for( auto & entry : snapshot.get_file_index() ) {
+      files[entry.second].push_back( entry.first );
+    }
+
+    out << "# sgug-rpm-tools package fixture\n";
+    for( size_t idx = 0 ; idx < packages.size() ; ++idx ) {
+      const installedrpm & package = packages[idx];
+      out << "package\t" << package.get_name() << "\t" <<
+	package.get_rpmfile() << "\n";
+      if( package.get_size() != 0 ) {
+	out << "size\t" << package.get_size() << "\n";
+      }
+      for( const string & require : package.get_requires() ) {
+	out << "require\t" << require << "\n";
+      }
+      unordered_set<string> implied_names = { package.get_name() };
+      for( const string & provide : package.get_provides() ) {
+	out << "provide\t" << provide << "\n";
+	implied_names.insert( provide_name_of( provide ) );
+      }
+      // Hash order would make dumps of the same snapshot differ
+      std::sort( provide_names[idx].begin(), provide_names[idx].end() );
+      for( const string & provide_name : provide_names[idx] ) {
+	if( implied_names.find( provide_name ) == implied_names.end() ) {
+	  out << "providename\t" << provide_name << "\n";
+	}
+      }
+      std::sort( files[idx].begin(), files[idx].end() );
+      for( const string & file : files[idx] ) {
+	out << "file\t" << file << "\n";
+      }
+    }
+    for( const specfile & spec : specs ) {
+      out << "spec\t" << spec.get_name() << "\t" << spec.get_filepath() << "\n";
+      for( const string & sub_package : spec.get_packages() ) {
+	out << "subpackage\t" << sub_package << "\n";
+	auto deps_finder = spec.get_build_deps().find( sub_package );
+	if( deps_finder == spec.get_build_deps().end() ) {
+	  continue;
+	}
+	for( const string & build_dep : deps_finder->second ) {
+	  out << "buildrequire\t" << sub_package << "\t" << build_dep << "\n";
+	}
+      }
+    }
+  }
+
+}
@@ -0,0 +1,138 @@
+#ifndef PACKAGESOURCE_HPP
+#define PACKAGESOURCE_HPP
+
+#include "helpers.hpp"
+#include "installeddb.hpp"
+#include "specfile.hpp"
+
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <rpm/rpmspec.h>
+
+namespace sgug_rpm {
+
+  // Where the tools get installed packages and parsed specs from: the
+  // live rpmdb + librpm spec parser, or a fixture file standing in for
+  // both so runs are reproducible on machines without an SGUG install.
+  class package_source {
+  public:
+    virtual ~package_source() {};
+
+    // Changes whenever load_installed would give a different snapshot;
+    // used to key installed_db_cache
+    virtual std::string get_installed_fingerprint() = 0;
+
+    virtual void load_installed( const bool verbose,
+				 installed_db_snapshot & snapshot,
+				 progress_printer & pprinter ) = 0;
+
+    // Path of the spec for package_name within the git tree, if any
+    virtual std::optional<std::string>
+    find_specfile( const std::string & gitrootdir,
+		   const std::string & package_name ) = 0;
+
+    // As sgug_rpm::read_specfiles; sources that don't parse anything
+    // may ignore jobs and cache
+    virtual void read_specfiles( const std::vector<std::string> & paths,
+				 rpmSpecFlags flags,
+				 unsigned int jobs,
+				 specfile_cache * cache,
+				 std::vector<specfile> & out_specfiles,
+				 std::vector<std::string> & error_specfiles,
+				 progress_printer & pprinter ) = 0;
+  };
+
+  class rpmdb_package_source : public package_source {
+  private:
+    poptcontext_h & _popt_context;
+
+  public:
+    rpmdb_package_source( poptcontext_h & popt_context )
+      : _popt_context(popt_context) {};
+
+    std::string get_installed_fingerprint() override;
+    void load_installed( const bool verbose,
+			 installed_db_snapshot & snapshot,
+			 progress_printer & pprinter ) override;
+    std::optional<std::string>
+    find_specfile( const std::string & gitrootdir,
+		   const std::string & package_name ) override;
+    void read_specfiles( const std::vector<std::string> & paths,
+			 rpmSpecFlags flags,
+			 unsigned int jobs,
+			 specfile_cache * cache,
+			 std::vector<specfile> & out_specfiles,
+			 std::vector<std::string> & error_specfiles,
+			 progress_printer & pprinter ) override;
+  };
+
+  // Tab separated fixture file, one record per line, '#' comments:
+  //
+  //   package      NAME  RPMFILE
+  //   size         BYTES              installed size, 0 if absent
+  //   require      REQUIRE
+  //   provide      PROVIDE            e.g. "foo = 1.0-1", indexed as foo
+  //   providename  NAME               indexed only
+  //   file         PATH
+  //   spec         NAME  PATH
+  //   subpackage   NAME
+  //   buildrequire SUBPACKAGE  REQUIRE
+  //
+  // size/require/provide/providename/file belong to the last package line,
+  // subpackage/buildrequire to the last spec line. Spec paths need not
+  // exist; find_specfile answers by spec name whatever the git root.
+  class fixture_package_source : public package_source {
+  private:
+    struct fixture_package {
+      installedrpm package;
+      std::vector<std::string> provide_names;
+      std::vector<std::string> files;
+    };
+
+    std::string _fingerprint;
+    std::vector<fixture_package> _packages;
+    std::vector<specfile> _specs;
+    std::unordered_map<std::string,size_t> _spec_by_name;
+    std::unordered_map<std::string,size_t> _spec_by_path;
+
+  public:
+    fixture_package_source() {};
+
+    // False, after reporting the offending line, on a malformed file
+    bool load( const std::string & fixturepath );
+
+    std::string get_installed_fingerprint() override;
+    void load_installed( const bool verbose,
+			 installed_db_snapshot & snapshot,
+			 progress_printer & pprinter ) override;
+    std::optional<std::string>
+    find_specfile( const std::string & gitrootdir,
+		   const std::string & package_name ) override;
+    void read_specfiles( const std::vector<std::string> & paths,
+			 rpmSpecFlags flags,
+			 unsigned int jobs,
+			 specfile_cache * cache,
+			 std::vector<specfile> & out_specfiles,
+			 std::vector<std::string> & error_specfiles,
+			 progress_printer & pprinter ) override;
+  };
+
+  // The fixture when fixturefile is set, the rpmdb otherwise. NULL if
+  // the fixture can't be loaded.
+  std::unique_ptr<package_source>
+  open_package_source( poptcontext_h & popt_context,
+		       const char * fixturefile );
+
+  // Writes snapshot and specs in the fixture format above
+  void write_package_fixture( std::ostream & out,
+			      const installed_db_snapshot & snapshot,
+			      const std::vector<specfile> & specs );
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "requirepaths.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <queue>
+
+using std::deque;
+using std::vector;
+
+namespace sgug_rpm {
+
+  require_paths::require_paths( const dep_graph & graph,
+				const vector<uint32_t> & root_nodes )
+    : _requirers( graph.reversed() ),
+      _depths( graph.get_num_nodes(), no_node ),
+      _parents( graph.get_num_nodes(), no_node ) {
+    deque<uint32_t> to_visit;
+    for( uint32_t root : root_nodes ) {
+      if( _depths[root] == no_node ) {
+	_depths[root] = 0;
+	to_visit.push_back( root );
+      }
+    }
+    while( !to_visit.empty() ) {
+      uint32_t node = to_visit.front();
+      to_visit.pop_front();
+      for( uint32_t child : graph.get_edges(node) ) {
+	if( _depths[child] == no_node ) {
+	  _depths[child] = _depths[node] + 1;
+	  _parents[child] = node;
+	  to_visit.push_back( child );
+	}
+      }
+    }
+  }
+
+  vector<uint32_t> require_paths::shortest_chain( uint32_t node ) const {
+    vector<uint32_t> chain;
+    if( !is_reached( node ) ) {
+      return chain;
+    }
+    for( uint32_t current = node ; current != no_node ;
+	 current = _parents[current] ) {
+      chain.push_back( current );
+    }
+    std::reverse( chain.begin(), chain.end() );
+    return chain;
+  }
+
+  void require_paths::find_chains( uint32_t node,
+				   size_t max_chains,
+				   vector<vector<uint32_t>> & chains_out ) const {
+    chains_out.clear();
+    if( !is_reached( node ) || max_chains == 0 ) {
+      return;
+    }
+    // Partial chains grow upwards from node and share their tails, each
+    // step pointing at the one below it
+    struct step {
+      uint32_t node;
+      uint32_t below;
+      uint32_t length;
+    };
+    vector<step> steps;
+    // (estimated full length, step) - smallest first, earliest on ties
+    typedef std::pair<uint32_t,uint32_t> candidate;
+    std::priority_queue<candidate, vector<candidate>,
+			std::greater<candidate>> candidates;
+    steps.push_back( step{ node, no_node, 0 } );
+    candidates.emplace( _depths[node], 0 );
+
+    // Chains that have to detour around loops can multiply; give up
+    // rather than wander the whole graph for a long tail of them
+    size_t budget = max_chains * _depths.size();
+    while( !candidates.empty() && chains_out.size() < max_chains &&
+	   budget-- > 0 ) {
+      uint32_t step_idx = candidates.top().second;
+      candidates.pop();
+      uint32_t top = steps[step_idx].node;
+      if( _depths[top] == 0 ) {
+	vector<uint32_t> chain;
+	for( uint32_t idx = step_idx ; idx != no_node ; idx = steps[idx].below ) {
+	  chain.push_back( steps[idx].node );
+	}
+	chains_out.push_back( chain );
+	continue;
+      }
+      for( uint32_t requirer : _requirers.get_edges(top) ) {
+	if( !is_reached( requirer ) ) {
+	  continue;
+	}
+	bool loops = false;
+	for( uint32_t idx = step_idx ; idx != no_node ; idx = steps[idx].below ) {
+	  if( steps[idx].node == requirer ) {
+	    loops = true;
+	    break;
+	  }
+	}
+	if( loops ) {
+	  continue;
+	}
+	uint32_t length = steps[step_idx].length + 1;
+	steps.push_back( step{ requirer, step_idx, length } );
+	candidates.emplace( length + _depths[requirer], steps.size() - 1 );
+      }
+    }
+  }
+
+}
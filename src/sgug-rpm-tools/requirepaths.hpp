@@ -0,0 +1,48 @@
+#ifndef REQUIREPATHS_HPP
+#define REQUIREPATHS_HPP
+
+#include "depgraph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Breadth first walk over a package graph from a set of root nodes,
+  // kept so "why is this node reached" is a walk back up rather than a
+  // new search. Each reached node keeps its distance (in requires) from
+  // the nearest root and the node that first reached it; the reversed
+  // graph supplies the other requirers for alternative chains.
+  class require_paths {
+  private:
+    dep_graph _requirers;
+    std::vector<uint32_t> _depths;
+    std::vector<uint32_t> _parents;
+
+  public:
+    static constexpr uint32_t no_node = UINT32_MAX;
+
+    require_paths( const dep_graph & graph,
+		   const std::vector<uint32_t> & root_nodes );
+
+    bool is_reached( uint32_t node ) const { return _depths[node] != no_node; };
+    // 0 for roots, no_node when not reached
+    uint32_t get_depth( uint32_t node ) const { return _depths[node]; };
+
+    // A shortest chain from a root down to node, root first; empty when
+    // node isn't reached
+    std::vector<uint32_t> shortest_chain( uint32_t node ) const;
+
+    // Up to max_chains distinct chains from a root down to node, shortest
+    // first. A chain visits each node at most once and starts at the
+    // first root met walking up. The depths give an exact estimate of
+    // what's left of every partial chain, so the search only strays from
+    // the shortest ones when a chain would loop.
+    void find_chains( uint32_t node,
+		      size_t max_chains,
+		      std::vector<std::vector<uint32_t>> & chains_out ) const;
+  };
+
+}
+
+#endif
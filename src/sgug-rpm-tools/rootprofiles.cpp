@@ -0,0 +1,108 @@
+#include "rootprofiles.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+using std::cerr;
+using std::endl;
+using std::ifstream;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace sgug_rpm {
+
+  static string trim( const string & str ) {
+    size_t first = str.find_first_not_of( " \t\r" );
+    if( first == string::npos ) {
+      return "";
+    }
+    size_t last = str.find_last_not_of( " \t\r" );
+    return str.substr( first, last - first + 1 );
+  }
+
+  static bool valid_profile_name( const string & name ) {
+    if( name.empty() || name == "." || name == ".." ) {
+      return false;
+    }
+    for( char c : name ) {
+      if( !isalnum((unsigned char)c) && c != '.' && c != '_' && c != '-' ) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  bool read_root_profiles( const string & profilespath,
+			   const vector<string> & default_roots,
+			   vector<root_profile> & profiles ) {
+    ifstream input( profilespath );
+    if( !input ) {
+      cerr << "Unable to read profiles " << profilespath << endl;
+      return false;
+    }
+    unordered_map<string,size_t> profile_index;
+    size_t line_no = 0;
+    for( string line; std::getline(input, line); ) {
+      ++line_no;
+      line = trim( line );
+      if( line.empty() || line[0] == '#' ) {
+	continue;
+      }
+      string problem;
+      if( line[0] == '[' ) {
+	string name = line.back() == ']' ?
+	  trim( line.substr( 1, line.size() - 2 ) ) : "";
+	if( !valid_profile_name( name ) ) {
+	  problem = "bad profile name";
+	}
+	else if( !profile_index.emplace( name, profiles.size() ).second ) {
+	  problem = "duplicate profile " + name;
+	}
+	else {
+	  profiles.push_back( root_profile{ name, {} } );
+	}
+      }
+      else if( profiles.empty() ) {
+	problem = "package outside a [profile]";
+      }
+      else if( line[0] == '@' ) {
+	string included = line.substr( 1 );
+	vector<string> & roots = profiles.back().roots;
+	auto finder = profile_index.find( included );
+	if( included == "default" ) {
+	  roots.insert( roots.end(), default_roots.begin(),
+			default_roots.end() );
+	}
+	else if( finder != profile_index.end() &&
+		 finder->second + 1 < profiles.size() ) {
+	  // Copy first, roots may be the vector being inserted from
+	  vector<string> included_roots = profiles[finder->second].roots;
+	  roots.insert( roots.end(), included_roots.begin(),
+			included_roots.end() );
+	}
+	else {
+	  problem = "unknown or later profile " + included;
+	}
+      }
+      else {
+	profiles.back().roots.push_back( line );
+      }
+      if( !problem.empty() ) {
+	cerr << profilespath << ":" << line_no << ": " << problem << endl;
+	return false;
+      }
+    }
+    for( root_profile & profile : profiles ) {
+      std::sort( profile.roots.begin(), profile.roots.end() );
+      profile.roots.erase( std::unique( profile.roots.begin(),
+					profile.roots.end() ),
+			   profile.roots.end() );
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,33 @@
+#ifndef ROOTPROFILES_HPP
+#define ROOTPROFILES_HPP
+
+#include <string>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // A named candidate minimal set: the packages kept along with
+  // everything they require
+  struct root_profile {
+    std::string name;
+    std::vector<std::string> roots;
+  };
+
+  // Profiles file, one package name per line under "[name]" headers:
+  //
+  //   # comment
+  //   [base]
+  //   @default        the built in special packages
+  //   [base-dnf]
+  //   @base           everything an earlier profile has
+  //   dnf
+  //
+  // Profile names end up as directory names so are limited to letters,
+  // digits, '.', '_' and '-'. False, after reporting why, on a bad file.
+  bool read_root_profiles( const std::string & profilespath,
+			   const std::vector<std::string> & default_roots,
+			   std::vector<root_profile> & profiles );
+
+}
+
+#endif
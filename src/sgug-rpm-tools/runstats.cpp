@@ -0,0 +1,179 @@
+#include "runstats.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+using std::cerr;
+using std::endl;
+using std::ofstream;
+using std::string;
+
+static int print_stats = 0;
+static char * stats_json_file = NULL;
+
+namespace sgug_rpm {
+
+  struct poptOption runStatsPoptTable[] = {
+    {
+      "stats",
+      '\0',
+      POPT_ARG_NONE,
+      &print_stats,
+      0,
+      "Print phase timings and counters to stderr when done",
+      NULL
+    },
+    {
+      "stats-json",
+      '\0',
+      POPT_ARG_STRING,
+      &stats_json_file,
+      0,
+      "Write phase timings and counters as JSON to FILE when done",
+      "FILE"
+    },
+    POPT_TABLEEND
+  };
+
+  // Fixed tables so recording never allocates or takes a lock; names
+  // beyond max_slots are silently not recorded.
+  static const size_t max_slots = 64;
+
+  struct stat_slot {
+    const char * name;
+    std::atomic<uint64_t> value;
+    // Phases only: total wall time in nanoseconds
+    std::atomic<uint64_t> nanos;
+  };
+
+  struct stat_table {
+    stat_slot slots[max_slots];
+    std::atomic<size_t> num_slots;
+  };
+
+  static stat_table counters;
+  static stat_table phases;
+  static std::mutex registration_mutex;
+
+  static size_t register_slot( stat_table & table, const char * name ) {
+    std::lock_guard<std::mutex> lock( registration_mutex );
+    size_t num_slots = table.num_slots.load();
+    for( size_t slot = 0 ; slot < num_slots ; ++slot ) {
+      if( string(table.slots[slot].name) == name ) {
+	return slot;
+      }
+    }
+    if( num_slots == max_slots ) {
+      return max_slots;
+    }
+    table.slots[num_slots].name = name;
+    table.num_slots.store( num_slots + 1 );
+    return num_slots;
+  }
+
+  stat_counter::stat_counter( const char * name )
+    : _slot(register_slot( counters, name )) {}
+
+  void stat_counter::add( uint64_t amount ) {
+    if( _slot < max_slots ) {
+      counters.slots[_slot].value.fetch_add( amount,
+					     std::memory_order_relaxed );
+    }
+  }
+
+  stat_phase::stat_phase( const char * name )
+    : _slot(register_slot( phases, name )) {}
+
+  void stat_phase::add_time( std::chrono::steady_clock::duration elapsed ) {
+    if( _slot < max_slots ) {
+      uint64_t nanos =
+	std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      phases.slots[_slot].value.fetch_add( 1, std::memory_order_relaxed );
+      phases.slots[_slot].nanos.fetch_add( nanos, std::memory_order_relaxed );
+    }
+  }
+
+  static double slot_ms( const stat_slot & slot ) {
+    return slot.nanos.load() / 1000000.0;
+  }
+
+  void print_run_stats( std::ostream & out ) {
+    char line[128];
+    snprintf( line, sizeof(line), "# %-34s %12s %10s\n",
+	      "phase", "wall ms", "calls" );
+    out << line;
+    for( size_t slot = 0 ; slot < phases.num_slots.load() ; ++slot ) {
+      const stat_slot & phase = phases.slots[slot];
+      if( phase.value.load() == 0 ) {
+	continue;
+      }
+      snprintf( line, sizeof(line), "# %-34s %12.2f %10llu\n", phase.name,
+		slot_ms( phase ), (unsigned long long)phase.value.load() );
+      out << line;
+    }
+    snprintf( line, sizeof(line), "# %-34s %12s\n", "counter", "count" );
+    out << line;
+    for( size_t slot = 0 ; slot < counters.num_slots.load() ; ++slot ) {
+      const stat_slot & counter = counters.slots[slot];
+      snprintf( line, sizeof(line), "# %-34s %12llu\n", counter.name,
+		(unsigned long long)counter.value.load() );
+      out << line;
+    }
+  }
+
+  static void print_json_string( std::ostream & out, const char * str ) {
+    out << '"';
+    for( ; *str != '\0' ; ++str ) {
+      if( *str == '"' || *str == '\\' ) {
+	out << '\\';
+      }
+      out << *str;
+    }
+    out << '"';
+  }
+
+  void print_run_stats_json( std::ostream & out ) {
+    char ms[32];
+    out << "{\"phases\":{";
+    bool first = true;
+    for( size_t slot = 0 ; slot < phases.num_slots.load() ; ++slot ) {
+      const stat_slot & phase = phases.slots[slot];
+      if( phase.value.load() == 0 ) {
+	continue;
+      }
+      out << (first ? "" : ",");
+      first = false;
+      print_json_string( out, phase.name );
+      snprintf( ms, sizeof(ms), "%.3f", slot_ms( phase ) );
+      out << ":{\"wall_ms\":" << ms << ",\"calls\":" <<
+	phase.value.load() << "}";
+    }
+    out << "},\"counters\":{";
+    first = true;
+    for( size_t slot = 0 ; slot < counters.num_slots.load() ; ++slot ) {
+      const stat_slot & counter = counters.slots[slot];
+      out << (first ? "" : ",");
+      first = false;
+      print_json_string( out, counter.name );
+      out << ":" << counter.value.load();
+    }
+    out << "}}\n";
+  }
+
+  void report_run_stats() {
+    if( print_stats ) {
+      print_run_stats( cerr );
+    }
+    if( stats_json_file != NULL ) {
+      ofstream json_out( stats_json_file );
+      print_run_stats_json( json_out );
+      if( !json_out ) {
+	cerr << "Unable to write stats to " << stats_json_file << endl;
+      }
+    }
+  }
+
+}
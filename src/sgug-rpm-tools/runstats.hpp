@@ -0,0 +1,63 @@
+#ifndef RUNSTATS_HPP
+#define RUNSTATS_HPP
+
+#include <rpm/rpmcli.h>
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace sgug_rpm {
+
+  // Process wide phase timers and counters. Recording is always on (a
+  // counter bump is a relaxed atomic add), --stats / --stats-json only
+  // decide whether report_run_stats() prints anything. Work done inside
+  // forked pool workers is not seen here - the pools count and time
+  // from the parent side instead.
+
+  // A named counter. Give it static storage so the name is registered
+  // once: static stat_counter lookups( "provider lookups" );
+  class stat_counter {
+    size_t _slot;
+  public:
+    stat_counter( const char * name );
+    void add( uint64_t amount = 1 );
+  };
+
+  // A named phase accumulating wall time and the number of times it
+  // was entered; static storage as for stat_counter.
+  class stat_phase {
+    size_t _slot;
+  public:
+    stat_phase( const char * name );
+    void add_time( std::chrono::steady_clock::duration elapsed );
+  };
+
+  // Adds the time from construction to destruction to a phase
+  class scoped_timer {
+    stat_phase & _phase;
+    std::chrono::steady_clock::time_point _start;
+  public:
+    scoped_timer( stat_phase & phase )
+      : _phase(phase), _start(std::chrono::steady_clock::now()) {}
+    scoped_timer( const scoped_timer & ) = delete;
+    scoped_timer & operator=( const scoped_timer & ) = delete;
+    ~scoped_timer() {
+      _phase.add_time( std::chrono::steady_clock::now() - _start );
+    }
+  };
+
+  // Phases in first-entered order, then counters, as aligned text
+  void print_run_stats( std::ostream & out );
+  // The same as a single JSON object
+  void print_run_stats_json( std::ostream & out );
+
+  // --stats and --stats-json FILE, include with POPT_ARG_INCLUDE_TABLE
+  extern struct poptOption runStatsPoptTable[];
+
+  // Emit whatever runStatsPoptTable asked for; call before exiting
+  void report_run_stats();
+
+}
+
+#endif
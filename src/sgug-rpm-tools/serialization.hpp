@@ -0,0 +1,98 @@
+#ifndef SERIALIZATION_HPP
+#define SERIALIZATION_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sgug_rpm {
+
+  // Minimal length-prefixed binary encoding used to hand data between
+  // worker processes and to/from on-disk caches. Values are written in
+  // host byte order - the data never leaves the machine that wrote it.
+  class serial_writer {
+    std::string & _buffer;
+
+  public:
+    serial_writer( std::string & buffer ) : _buffer(buffer) {}
+
+    void put_bytes( const void * data, size_t len ) {
+      _buffer.append( static_cast<const char *>(data), len );
+    }
+
+    void put_u8( uint8_t value ) { put_bytes( &value, sizeof(value) ); };
+    void put_u32( uint32_t value ) { put_bytes( &value, sizeof(value) ); };
+    void put_u64( uint64_t value ) { put_bytes( &value, sizeof(value) ); };
+
+    void put_string( const std::string & value ) {
+      put_u32( static_cast<uint32_t>(value.size()) );
+      put_bytes( value.data(), value.size() );
+    }
+
+    void put_strings( const std::vector<std::string> & values ) {
+      put_u32( static_cast<uint32_t>(values.size()) );
+      for( const std::string & value : values ) {
+	put_string( value );
+      }
+    }
+  };
+
+  class serial_reader {
+    const char * _cur;
+    const char * _end;
+
+  public:
+    serial_reader( const char * data, size_t len )
+      : _cur(data), _end(data + len) {}
+    serial_reader( const std::string & buffer )
+      : serial_reader( buffer.data(), buffer.size() ) {}
+
+    size_t remaining() const { return _end - _cur; };
+
+    bool get_bytes( void * dest, size_t len ) {
+      if( remaining() < len ) {
+	return false;
+      }
+      memcpy( dest, _cur, len );
+      _cur += len;
+      return true;
+    }
+
+    bool get_u8( uint8_t & value ) { return get_bytes( &value, sizeof(value) ); };
+    bool get_u32( uint32_t & value ) { return get_bytes( &value, sizeof(value) ); };
+    bool get_u64( uint64_t & value ) { return get_bytes( &value, sizeof(value) ); };
+
+    bool get_string( std::string & value ) {
+      uint32_t len;
+      if( !get_u32(len) || remaining() < len ) {
+	return false;
+      }
+      value.assign( _cur, len );
+      _cur += len;
+      return true;
+    }
+
+    bool get_strings( std::vector<std::string> & values ) {
+      uint32_t count;
+      // Every string takes at least its length, so a count the rest of
+      // the buffer can't hold is corrupt - don't reserve for it
+      if( !get_u32(count) || remaining() / sizeof(uint32_t) < count ) {
+	return false;
+      }
+      values.clear();
+      values.reserve( count );
+      for( uint32_t i = 0 ; i < count ; ++i ) {
+	std::string value;
+	if( !get_string(value) ) {
+	  return false;
+	}
+	values.emplace_back( std::move(value) );
+      }
+      return true;
+    }
+  };
+
+}
+
+#endif
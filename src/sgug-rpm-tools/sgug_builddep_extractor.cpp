@@ -3,6 +3,7 @@
 #include "installedrpm.hpp"
 #include "standalonerpm.hpp"
 #include "dependencyset.hpp"
+#include "runstats.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -47,6 +48,10 @@ static struct poptOption optionsTable[] = {
     NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
     "Common options for all rpm modes and executables",
     NULL },
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, sgug_rpm::runStatsPoptTable, 0,
+    "Instrumentation options",
+    NULL },
   POPT_AUTOALIAS
   POPT_AUTOHELP
   POPT_TABLEEND
@@ -122,5 +127,7 @@ int main(int argc, char**argv)
     }
   }
 
+  sgug_rpm::report_run_stats();
+
   return 0;
 }
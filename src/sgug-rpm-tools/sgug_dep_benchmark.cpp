@@ -0,0 +1,371 @@
+#include "helpers.hpp"
+#include "installedrpm.hpp"
+#include "installeddb.hpp"
+#include "installeddbcache.hpp"
+#include "packagesource.hpp"
+#include "bufferedoutput.hpp"
+#include "depclosure.hpp"
+#include "depgraph.hpp"
+#include "sgug_dep_engine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <rpm/rpmcli.h>
+#include <rpm/rpmlog.h>
+
+// C++ structures/algorithms
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::function;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+static int num_packages = 5000;
+static double fanout = 8.0;
+static double cycle_density = 0.01;
+static double file_require_ratio = 0.2;
+static int seed = 1;
+static int iterations = 3;
+static int jobs = 1;
+static char * fixturefile = NULL;
+static char * dumpfile = NULL;
+
+static struct poptOption optionsTable[] = {
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
+    "Common options for all rpm modes and executables",
+    NULL },
+  {
+    "packages",
+    'n',
+    POPT_ARG_INT,
+    &num_packages,
+    0,
+    "Number of synthetic packages (default 5000)",
+    "N"
+  },
+  {
+    "fanout",
+    'f',
+    POPT_ARG_DOUBLE,
+    &fanout,
+    0,
+    "Average requires per package (default 8)",
+    "F"
+  },
+  {
+    "cycles",
+    'c',
+    POPT_ARG_DOUBLE,
+    &cycle_density,
+    0,
+    "Fraction of requires pointing back up the graph, forming cycles (default 0.01)",
+    "RATIO"
+  },
+  {
+    "filereqs",
+    'r',
+    POPT_ARG_DOUBLE,
+    &file_require_ratio,
+    0,
+    "Fraction of requires that are file paths (default 0.2)",
+    "RATIO"
+  },
+  {
+    "seed",
+    's',
+    POPT_ARG_INT,
+    &seed,
+    0,
+    "Random seed, the same seed always gives the same package set",
+    "N"
+  },
+  {
+    "iterations",
+    'i',
+    POPT_ARG_INT,
+    &iterations,
+    0,
+    "Times each phase is run (default 3)",
+    "N"
+  },
+  {
+    "jobs",
+    'j',
+    POPT_ARG_INT,
+    &jobs,
+    0,
+    "Number of threads used to compute levels",
+    "N"
+  },
+  {
+    "fixture",
+    '\0',
+    POPT_ARG_STRING,
+    &fixturefile,
+    0,
+    "Time a package fixture (see sgug_minimal_computer --dumpfixture) instead of a generated set",
+    "FILE"
+  },
+  {
+    "dump",
+    '\0',
+    POPT_ARG_STRING,
+    &dumpfile,
+    0,
+    "Write the package set being timed to a fixture file",
+    "FILE"
+  },
+  POPT_AUTOALIAS
+  POPT_AUTOHELP
+  POPT_TABLEEND
+};
+
+// The rpmdb view of one synthetic package
+struct synthetic_package {
+  sgug_rpm::installedrpm package;
+  vector<string> provide_names;
+  vector<string> files;
+};
+
+// Package i provides its name, a soname and owns a library and a binary.
+// Requires mostly point at lower numbered packages (so the set is a DAG
+// apart from the requested fraction of back edges), skewed towards low
+// numbers the way glibc and friends are required by nearly everything.
+static vector<synthetic_package> generate_packages( size_t count,
+						    std::mt19937 & rng,
+						    size_t & num_requires_out,
+						    size_t & num_file_requires_out ) {
+  vector<synthetic_package> retval;
+  std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+  std::poisson_distribution<int> num_requires_dist( fanout );
+  num_requires_out = 0;
+  num_file_requires_out = 0;
+
+  for( size_t idx = 0 ; idx < count ; ++idx ) {
+    string name = "synth" + std::to_string(idx);
+    string soname = "lib" + name + ".so.1";
+    vector<string> provides = { name + " = 1.0-1", soname };
+    vector<string> provide_names = { name, soname };
+    vector<string> files = { "/usr/sgug/lib32/" + soname,
+			     "/usr/sgug/bin/" + name };
+
+    vector<string> requires;
+    int num_requires = idx == 0 ? 0 : num_requires_dist( rng );
+    for( int r = 0 ; r < num_requires ; ++r ) {
+      size_t target;
+      if( unit( rng ) < cycle_density ) {
+	target = idx + 1 + (size_t)( unit( rng ) * (count - idx - 1) );
+	if( target >= count ) {
+	  continue;
+	}
+      }
+      else {
+	double skew = unit( rng );
+	target = (size_t)( skew * skew * idx );
+      }
+      string target_name = "synth" + std::to_string(target);
+      if( unit( rng ) < file_require_ratio ) {
+	requires.push_back( "/usr/sgug/bin/" + target_name );
+	num_file_requires_out++;
+      }
+      else if( unit( rng ) < 0.5 ) {
+	requires.push_back( "lib" + target_name + ".so.1" );
+      }
+      else {
+	requires.push_back( target_name );
+      }
+    }
+    std::sort( requires.begin(), requires.end() );
+    requires.erase( std::unique( requires.begin(), requires.end() ),
+		    requires.end() );
+    num_requires_out += requires.size();
+
+    // Not drawn from rng so a seed still gives the same graph as before
+    uint64_t size = 4096 * (1 + (idx * 2654435761u) % 8192);
+
+    retval.push_back( synthetic_package{
+	sgug_rpm::installedrpm( name, name + "-1.0-1.mips.rpm",
+				requires, provides, size ),
+	provide_names, files } );
+  }
+  return retval;
+}
+
+static long peak_rss_kb() {
+  struct rusage usage;
+  if( getrusage( RUSAGE_SELF, &usage ) != 0 ) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+// Runs phase iterations times, printing the best and mean wall time and
+// items/second based on the best run
+static void time_phase( const string & phase_name,
+			size_t num_items,
+			const function<void ()> & phase ) {
+  double best_ms = 0.0;
+  double total_ms = 0.0;
+  for( int i = 0 ; i < iterations ; ++i ) {
+    auto start = std::chrono::steady_clock::now();
+    phase();
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>( end - start ).count();
+    best_ms = (i == 0 || ms < best_ms) ? ms : best_ms;
+    total_ms += ms;
+  }
+  double per_second = best_ms > 0.0 ? num_items / (best_ms / 1000.0) : 0.0;
+  printf( "%-22s %10.2f %10.2f %14.0f %10ld\n", phase_name.c_str(),
+	  best_ms, total_ms / iterations, per_second, peak_rss_kb() );
+}
+
+int main(int argc, char**argv)
+{
+  sgug_rpm::poptcontext_h popt_context( argc, argv, optionsTable );
+  rpmlogSetMask(RPMLOG_ERR);
+
+  if( popt_context.context == NULL ) {
+    exit(EXIT_FAILURE);
+  }
+  if( num_packages < 1 || iterations < 1 ) {
+    cerr << "packages and iterations must be at least 1" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Spinner output would only add noise (and time) to the phases
+  sgug_rpm::progress_printer pprinter( false );
+  unsigned int num_jobs = jobs > 0 ? jobs : 1;
+
+  std::unique_ptr<sgug_rpm::fixture_package_source> fixture;
+  vector<synthetic_package> synthetic;
+  string set_description;
+  if( fixturefile != NULL ) {
+    fixture.reset( new sgug_rpm::fixture_package_source() );
+    if( !fixture->load( fixturefile ) ) {
+      exit(EXIT_FAILURE);
+    }
+    set_description = string("fixture ") + fixturefile;
+  }
+  else {
+    std::mt19937 rng( seed );
+    size_t num_requires, num_file_requires;
+    synthetic = generate_packages( num_packages, rng, num_requires,
+				   num_file_requires );
+    set_description = "seed " + std::to_string(seed) + ", " +
+      std::to_string(num_file_requires) + " file requires";
+  }
+
+  sgug_rpm::installed_db_snapshot installed_db;
+  auto fill_snapshot = [&]() {
+    installed_db = sgug_rpm::installed_db_snapshot();
+    if( fixture ) {
+      fixture->load_installed( false, installed_db, pprinter );
+      return;
+    }
+    for( synthetic_package & pkg : synthetic ) {
+      installed_db.add_package( pkg.package, pkg.provide_names,
+				pkg.files );
+    }
+  };
+  fill_snapshot();
+
+  size_t num_requires = 0;
+  for( const sgug_rpm::installedrpm & package : installed_db.get_packages() ) {
+    num_requires += package.get_requires().size();
+  }
+  size_t num_set_packages = installed_db.get_packages().size();
+
+  if( dumpfile != NULL ) {
+    sgug_rpm::buffered_output_file dump_out( dumpfile );
+    sgug_rpm::write_package_fixture( dump_out, installed_db, {} );
+    if( !dump_out.commit() ) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  cout << "# " << num_set_packages << " packages, " << num_requires <<
+    " requires (" << set_description << "), " << iterations <<
+    " iteration(s), " << jobs << " job(s)" << endl;
+  printf( "%-22s %10s %10s %14s %10s\n", "# phase", "best ms", "mean ms",
+	  "items/s", "peak KB" );
+
+  time_phase( "snapshot index", num_set_packages, fill_snapshot );
+
+  string cachepath = "/tmp/sgug_dep_benchmark." + std::to_string(getpid());
+  time_phase( "snapshot cache save", num_set_packages, [&]() {
+		sgug_rpm::installed_db_cache dbcache( cachepath, "benchmark" );
+		dbcache.save( installed_db, NULL, NULL );
+	      });
+  time_phase( "snapshot cache load", num_set_packages, [&]() {
+		sgug_rpm::installed_db_cache dbcache( cachepath, "benchmark" );
+		sgug_rpm::installed_db_snapshot loaded;
+		if( !dbcache.load( loaded ) ) {
+		  cerr << "Cache reload failed" << endl;
+		}
+	      });
+  unlink( cachepath.c_str() );
+
+  const vector<sgug_rpm::installedrpm> & packages = installed_db.get_packages();
+  sgug_rpm::dep_graph graph;
+  time_phase( "graph build", num_requires, [&]() {
+		vector<string> missing_deps;
+		graph = sgug_rpm::build_package_graph( packages, installed_db,
+						       missing_deps, pprinter );
+	      });
+
+  time_phase( "scc", graph.get_num_edges(), [&]() {
+		sgug_rpm::dep_graph_sccs sccs( graph );
+	      });
+
+  sgug_rpm::dep_graph_sccs sccs( graph );
+  time_phase( "levels", sccs.get_num_components(), [&]() {
+		vector<uint32_t> component_levels;
+		sgug_rpm::compute_component_levels( graph, sccs, num_jobs,
+						    component_levels );
+	      });
+
+  time_phase( "reverse closure index", sccs.get_num_components(), [&]() {
+		sgug_rpm::reverse_closure_index closures( graph );
+	      });
+
+  // Real package sets get the real minimal set
+  vector<string> special_packages = fixture ?
+    sgug_rpm::default_special_packages() : vector<string>{ "synth0" };
+  auto is_special = [&]( const string & pkg_name ) -> bool {
+    return std::find( special_packages.begin(), special_packages.end(),
+		      pkg_name ) != special_packages.end();
+  };
+  time_phase( "flatten sort (total)", packages.size(), [&]() {
+		vector<sgug_rpm::installedrpm> rpms_to_resolve = packages;
+		vector<string> missing_deps;
+		vector<vector<string> > cycle_groups;
+		sgug_rpm::flatten_sort_packages( rpms_to_resolve,
+						 installed_db,
+						 is_special,
+						 missing_deps,
+						 cycle_groups,
+						 num_jobs,
+						 pprinter );
+	      });
+
+  cout << "# " << graph.get_num_edges() << " edges, " <<
+    sccs.get_num_components() << " components" << endl;
+
+  return 0;
+}
@@ -1,9 +1,11 @@
 #include "sgug_dep_engine.hpp"
+#include "depgraph.hpp"
+#include "runstats.hpp"
+#include "stringinterner.hpp"
 
-#include <stack>
+#include <deque>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include <algorithm>
@@ -13,15 +15,13 @@
 #include <iostream>
 #include <sstream>
 
+using std::deque;
 using std::function;
 using std::optional;
 using std::pair;
-using std::reference_wrapper;
-using std::stack;
 using std::string;
 using std::stringstream;
 using std::unordered_map;
-using std::unordered_set;
 using std::vector;
 
 using std::endl;
@@ -29,232 +29,477 @@ using std::cout;
 
 namespace sgug_rpm {
 
-  static optional<uint32_t> recursive_flatten_deps(
-					  vector<string> & missing_deps_out,
-					  resolvedrpm & driving_pkg,
-					  vector<resolvedrpm> & known_packages,
-					  unordered_map<string,std::reference_wrapper<resolvedrpm> > & pid_to_package,
-					  unordered_map<string,std::reference_wrapper<resolvedrpm> > & provides_to_package,
-					  unordered_set<string> & done_packages,
-					  resolvedrpm & current_pkg,
-					  vector<string> & pkg_resolution_stack,
-					  const function<bool (const string&)> & special_strategy,
-					  bool parent_is_special,
-					  progress_printer & pprinter )
-  {
-    const string & pkg_name = current_pkg.get_package().get_name();
+  static const uint32_t no_package = string_interner::no_id;
+
+  // The snapshot's string table, plus any strings packages from
+  // elsewhere bring, numbered on from it
+  class graph_strings {
+    const string_interner & _snapshot_strings;
+    string_interner _extra;
 
-    //    cout << "do irfp on " << pkg_name << endl;
+  public:
+    graph_strings( const string_interner & snapshot_strings )
+      : _snapshot_strings(snapshot_strings) {}
 
-    if( done_packages.find(pkg_name) != done_packages.end() ) {
-      //      cout << "RPM " << pkg_name << " already processed." << endl;
-      auto pfinder = pid_to_package.find(pkg_name);
-      return pfinder->second.get().get_sequence_no();
+    uint32_t intern( const string & value ) {
+      optional<uint32_t> id = _snapshot_strings.find( value );
+      if( id ) {
+	return *id;
+      }
+      return _snapshot_strings.size() + _extra.intern( value );
     }
 
-    bool is_special = special_strategy(pkg_name) || parent_is_special;
-
-    //    for( const string & sname : pkg_resolution_stack ) {
-    //      cout << "PRS: " << sname << endl;
-    //    }
-
-    if( std::find(pkg_resolution_stack.begin(), pkg_resolution_stack.end(), pkg_name)
-	!= pkg_resolution_stack.end() ) {
-      //      cout << "Dependency cycle detected with driving pkg: " <<
-      //	pkg_name << endl;
-      //      for( const string & spkg : pkg_resolution_stack ) {
-      //	cout << "Stack: " << spkg << endl;
-      //      }
-      auto pfinder = pid_to_package.find(pkg_name);
-      if( pfinder != pid_to_package.end() ) {
-	return pfinder->second.get().get_sequence_no();
+    optional<uint32_t> find( const string & value ) const {
+      optional<uint32_t> id = _snapshot_strings.find( value );
+      if( id ) {
+	return id;
       }
-      else {
-	return {};
+      id = _extra.find( value );
+      if( id ) {
+	return { _snapshot_strings.size() + *id };
       }
+      return {};
     }
-    pkg_resolution_stack.push_back(pkg_name);
-
-    const vector<string> & pkg_requires = current_pkg.get_package().get_requires();
-
-    uint32_t sequence_no = 0;
-
-    for( const string & pkg_require : pkg_requires ) {
-      //      cout << "Looking for provider of " << pkg_require << endl;
-      optional<reference_wrapper<resolvedrpm> > provider_ref_opt;
 
-      auto piter = provides_to_package.find(pkg_require);
-
-      if( piter != provides_to_package.end() ) {
-	resolvedrpm & child_pkg = piter->second.get();
-	provider_ref_opt = {child_pkg};
+    const string & get_string( uint32_t id ) const {
+      if( id < _snapshot_strings.size() ) {
+	return _snapshot_strings.get_string( id );
+      }
+      return _extra.get_string( id - _snapshot_strings.size() );
+    }
+  };
+
+  // Fallback resolution for requires that aren't a name/provide of the
+  // packages being resolved (mostly file requires). Answers come from
+  // the snapshot indexes and are memoised per require id - misses
+  // included - so each distinct require is only looked up once.
+  class fallback_provider_index {
+    const installed_db_snapshot & _installed_db;
+    const graph_strings & _strings;
+    const vector<uint32_t> & _name_to_package;
+    unordered_map<uint32_t,uint32_t> _memo;
+
+  public:
+    fallback_provider_index( const installed_db_snapshot & installed_db,
+			     const graph_strings & strings,
+			     const vector<uint32_t> & name_to_package )
+      : _installed_db(installed_db),
+	_strings(strings),
+	_name_to_package(name_to_package) {}
+
+    uint32_t find( uint32_t required_id ) {
+      static stat_counter memo_hits( "fallback provider memo hits" );
+      auto mfind = _memo.find( required_id );
+      if( mfind != _memo.end() ) {
+	memo_hits.add();
+	return mfind->second;
       }
 
-      if( !provider_ref_opt ) {
-	/* Didn't resolve from simple prov/req */
-	optional<pair<string,string>> provider_pkg_name_opt =
-	  find_package_providing_file( pkg_require );
-
-	if( provider_pkg_name_opt ) {
-	  string & provider_pkg_name = (*provider_pkg_name_opt).first;
-	  auto p2pfind = pid_to_package.find( provider_pkg_name );
-	  if( p2pfind != pid_to_package.end() ) {
-	    resolvedrpm & child_pkg = p2pfind->second.get();
-	    provider_ref_opt = {child_pkg};
-	  }
+      const string & required = _strings.get_string( required_id );
+      uint32_t provider = no_package;
+      optional<pair<string,string> > provider_pkg_name_opt =
+	_installed_db.find_package_providing_file( required );
+      if( !provider_pkg_name_opt ) {
+	provider_pkg_name_opt =
+	  _installed_db.find_package_providing_tag( required );
+      }
+      if( provider_pkg_name_opt ) {
+	optional<uint32_t> name_id_opt =
+	  _strings.find( (*provider_pkg_name_opt).first );
+	if( name_id_opt && *name_id_opt < _name_to_package.size() ) {
+	  provider = _name_to_package[*name_id_opt];
 	}
       }
+      _memo.emplace( required_id, provider );
+      return provider;
+    }
+  };
 
-      if( !provider_ref_opt ) {
-	/* Didn't resolve from simple prov/req */
-	optional<pair<string,string>> provider_pkg_tag_opt =
-	  find_package_providing_tag( pkg_require );
-
-	if( provider_pkg_tag_opt ) {
-	  string & provider_pkg_name = (*provider_pkg_tag_opt).first;
-	  auto p2pfind = pid_to_package.find( provider_pkg_name );
-	  if( p2pfind != pid_to_package.end() ) {
-	    resolvedrpm & child_pkg = p2pfind->second.get();
-	    provider_ref_opt = {child_pkg};
+  static void assign_if_unset( vector<uint32_t> & table, uint32_t id,
+			       uint32_t idx ) {
+    if( id >= table.size() ) {
+      table.resize( id + 1, no_package );
+    }
+    if( table[id] == no_package ) {
+      table[id] = idx;
+    }
+  }
+
+  // Finds which of the packages being sorted satisfies a require, the
+  // same way for both sorts: the first package of the set named or
+  // providing it, then the file and provide indexes of the snapshot.
+  // Every name/provide/require is an id in the snapshot's string table
+  // (or interned here, for packages the snapshot doesn't hold) so
+  // resolution is a lookup in a flat table indexed by string id.
+  class package_resolver {
+    graph_strings _strings;
+    vector<const interned_package *> _package_ids;
+    // Reserved so the pointers into it stay put
+    vector<interned_package> _interned_here;
+    vector<uint32_t> _name_to_package;
+    vector<uint32_t> _provides_to_package;
+    fallback_provider_index _fallback_providers;
+
+  public:
+    package_resolver( const vector<installedrpm> & packages,
+		      const installed_db_snapshot & installed_db )
+      : _strings(installed_db.get_strings()),
+	_package_ids(packages.size()),
+	_fallback_providers(installed_db, _strings, _name_to_package) {
+      _interned_here.reserve( packages.size() );
+      for( uint32_t idx = 0 ; idx < packages.size() ; ++idx ) {
+	const installedrpm & package = packages[idx];
+	_package_ids[idx] = installed_db.find_interned( package );
+	if( _package_ids[idx] == NULL ) {
+	  interned_package ids;
+	  ids.name = _strings.intern( package.get_name() );
+	  for( const string & require : package.get_requires() ) {
+	    ids.requires.push_back( _strings.intern( require ) );
+	  }
+	  for( const string & provide : package.get_provides() ) {
+	    ids.provides.push_back( _strings.intern( provide ) );
 	  }
+	  _interned_here.push_back( std::move(ids) );
+	  _package_ids[idx] = &_interned_here.back();
 	}
       }
 
-      if( !provider_ref_opt ) {
-	stringstream missing_deps_buf;
-	missing_deps_buf << "Package " << pkg_name << " has missing requires: " << pkg_require;
-	missing_deps_out.push_back(missing_deps_buf.str());
-	continue;
+      for( uint32_t idx = 0 ; idx < packages.size() ; ++idx ) {
+	const interned_package & ids = *_package_ids[idx];
+	assign_if_unset( _name_to_package, ids.name, idx );
+	assign_if_unset( _provides_to_package, ids.name, idx );
+	for( uint32_t provide_id : ids.provides ) {
+	  assign_if_unset( _provides_to_package, provide_id, idx );
+	}
       }
+    }
 
-      resolvedrpm & child_pkg = *provider_ref_opt;
+    const vector<uint32_t> & get_requires( uint32_t idx ) const {
+      return _package_ids[idx]->requires;
+    }
 
-      //      cout << "Found provider for " << pkg_require << endl;
+    const string & get_string( uint32_t id ) const {
+      return _strings.get_string( id );
+    }
 
-      const string & child_pkg_name = child_pkg.get_package().get_name();
+    uint32_t find_provider( uint32_t require_id ) {
+      if( require_id < _provides_to_package.size() &&
+	  _provides_to_package[require_id] != no_package ) {
+	return _provides_to_package[require_id];
+      }
+      /* Didn't resolve from simple prov/req */
+      return _fallback_providers.find( require_id );
+    }
+  };
+
+  // The graph sorts and de-duplicates its edges; find where each
+  // (from, to) pair ended up and give it the first require seen for it
+  static void label_edges( const dep_graph & graph,
+			   const vector<pair<uint32_t,uint32_t>> & edge_pairs,
+			   const function<const string & (size_t)> & require_of,
+			   vector<string> & edge_requires_out ) {
+    const vector<uint32_t> & offsets = graph.get_offsets();
+    const vector<uint32_t> & edges = graph.get_edge_array();
+    edge_requires_out.assign( edges.size(), string() );
+    for( size_t i = 0 ; i < edge_pairs.size() ; ++i ) {
+      uint32_t from = edge_pairs[i].first;
+      auto position = std::lower_bound( edges.begin() + offsets[from],
+					edges.begin() + offsets[from + 1],
+					edge_pairs[i].second );
+      string & edge_require = edge_requires_out[position - edges.begin()];
+      if( edge_require.empty() ) {
+	edge_require = require_of( i );
+      }
+    }
+  }
+
+  dep_graph build_package_graph( const vector<installedrpm> & packages,
+				 const installed_db_snapshot & installed_db,
+				 vector<string> & missing_deps_out,
+				 progress_printer & pprinter,
+				 vector<uint32_t> * missing_dep_packages_out,
+				 vector<string> * edge_requires_out )
+  {
+    static stat_phase build_phase( "graph build" );
+    scoped_timer timer( build_phase );
+    package_resolver resolver( packages, installed_db );
+
+    vector<pair<uint32_t,uint32_t>> edge_pairs;
+    vector<uint32_t> edge_require_ids;
+    for( uint32_t idx = 0 ; idx < packages.size() ; ++idx ) {
+      const installedrpm & package = packages[idx];
+      for( uint32_t require_id : resolver.get_requires( idx ) ) {
+	uint32_t provider = resolver.find_provider( require_id );
+	if( provider == no_package ) {
+	  stringstream missing_deps_buf;
+	  missing_deps_buf << "Package " << package.get_name() <<
+	    " has missing requires: " << resolver.get_string( require_id );
+	  missing_deps_out.push_back(missing_deps_buf.str());
+	  if( missing_dep_packages_out != NULL ) {
+	    missing_dep_packages_out->push_back( idx );
+	  }
+	  continue;
+	}
 
-      if( child_pkg_name == pkg_name ) {
-	//	cout << "Found package depending on itself: " << child_pkg_name << endl;
-	continue;
+	// Packages depending on themselves don't affect ordering
+	if( provider != idx ) {
+	  edge_pairs.emplace_back( idx, provider );
+	  if( edge_requires_out != NULL ) {
+	    edge_require_ids.push_back( require_id );
+	  }
+	}
       }
+      pprinter.accept_progress();
+    }
 
-      //      cout << "It is " << child_pkg.get_package().get_name() << endl;
-
-      optional<uint32_t> child_sequence_no_opt =
-	recursive_flatten_deps( missing_deps_out,
-				driving_pkg,
-				known_packages,
-				pid_to_package,
-				provides_to_package,
-				done_packages,
-				child_pkg,
-				pkg_resolution_stack,
-				special_strategy,
-				is_special,
-				pprinter );
-
-      if( child_sequence_no_opt ) {
-	uint32_t child_sequence_no = *child_sequence_no_opt;
-	uint32_t tmp_sequence_no = child_sequence_no + 1;
-
-	if( tmp_sequence_no > sequence_no ) {
-	  //	  cout << "Upgrading " << pkg_name << " sequence from " << sequence_no <<
-	  //	    " to " << tmp_sequence_no << endl;
-	  sequence_no = tmp_sequence_no;
+    if( edge_requires_out == NULL ) {
+      return dep_graph( packages.size(), edge_pairs );
+    }
+    // The graph consumes the pairs, so label from a copy
+    vector<pair<uint32_t,uint32_t>> labelled_pairs( edge_pairs );
+    dep_graph graph( packages.size(), edge_pairs );
+    label_edges( graph, labelled_pairs,
+		 [&]( size_t i ) -> const string & {
+		   return resolver.get_string( edge_require_ids[i] );
+		 },
+		 *edge_requires_out );
+    return graph;
+  }
+
+  // Everything reachable through requires from a special package is special
+  static void mark_special_packages( vector<resolvedrpm> & packages,
+				     const dep_graph & graph,
+				     const function<bool (const string&)> & special_strategy )
+  {
+    vector<bool> reached( packages.size(), false );
+    deque<uint32_t> to_visit;
+    for( uint32_t idx = 0 ; idx < packages.size() ; ++idx ) {
+      if( special_strategy(packages[idx].get_package().get_name()) ) {
+	reached[idx] = true;
+	to_visit.push_back(idx);
+      }
+    }
+    while( !to_visit.empty() ) {
+      uint32_t idx = to_visit.front();
+      to_visit.pop_front();
+      for( uint32_t child : graph.get_edges(idx) ) {
+	if( !reached[child] ) {
+	  reached[child] = true;
+	  to_visit.push_back(child);
 	}
       }
+    }
+    for( uint32_t idx = 0 ; idx < packages.size() ; ++idx ) {
+      packages[idx].set_special( reached[idx] );
+    }
+  }
 
-      pprinter.accept_progress();
+  // Sequence numbers from the component levels; every multi-member
+  // component is reported as a sorted cycle group
+  static void assign_sequence_numbers( vector<resolvedrpm> & packages,
+				       const dep_graph_sccs & sccs,
+				       const vector<uint32_t> & component_levels,
+				       vector<vector<string> > & cycle_groups_out ) {
+    for( uint32_t idx = 0 ; idx < packages.size() ; ++idx ) {
+      packages[idx].set_sequence_no( component_levels[sccs.get_component(idx)] );
     }
 
-    current_pkg.set_sequence_no(sequence_no);
-    current_pkg.set_special(is_special);
-    if( done_packages.find(pkg_name) == done_packages.end() ) {
-      done_packages.emplace(pkg_name);
+    for( uint32_t component = 0 ; component < sccs.get_num_components() ; ++component ) {
+      const vector<uint32_t> & members = sccs.get_members(component);
+      if( members.size() > 1 ) {
+	vector<string> cycle_group;
+	for( uint32_t member : members ) {
+	  cycle_group.push_back( packages[member].get_package().get_name() );
+	}
+	std::sort( cycle_group.begin(), cycle_group.end() );
+	cycle_groups_out.emplace_back( cycle_group );
+      }
     }
+    std::sort( cycle_groups_out.begin(), cycle_groups_out.end() );
+  }
 
-    pkg_resolution_stack.pop_back();
+  static void sort_resolved_packages( vector<resolvedrpm> & packages ) {
+    std::sort(packages.begin(),packages.end(),
+	      []( const resolvedrpm & a, const resolvedrpm & b ) -> bool {
+		// Sort them by sequenceNumber, then by name
+		// (to ensure stable results)
+		if( a.get_sequence_no() == b.get_sequence_no() ) {
+		  return a.get_package().get_name() < b.get_package().get_name();
+		}
+		else {
+		  return a.get_sequence_no() < b.get_sequence_no();
+		}
+	      });
+  }
 
-    return {sequence_no};
+  vector<string> default_special_packages() {
+    vector<string> retval;
+    retval.push_back("rpm");
+    retval.push_back("sudo");
+    retval.push_back("vim-minimal");
+    retval.push_back("tar");
+    retval.push_back("bzip2");
+    retval.push_back("gzip");
+    retval.push_back("xz");
+    retval.push_back("unzip");
+    retval.push_back("openssh-clients");
+    retval.push_back("libiconv");
+    retval.push_back("info");
+    retval.push_back("desktop-file-utils");
+
+    retval.push_back("sgugshell");
+
+    retval.push_back("dnf-data");
+    retval.push_back("microdnf");
+    retval.push_back("tdnf");
+
+    retval.push_back("sgugrse-release");
+    retval.push_back("sgugrse-repos-ostree");
+    retval.push_back("sgugrse-repos");
+    retval.push_back("sgugrse-release-common");
+    retval.push_back("sgugrse-gpg-keys");
+    /*retval.push_back("git-all");*/
+    /*retval.push_back("sgug-getopt");*/
+    return retval;
   }
 
   vector<resolvedrpm> flatten_sort_packages( vector<installedrpm> & rpms_to_resolve,
+					     const installed_db_snapshot & installed_db,
 					     const function<bool (const string&)> & special_strategy,
 					     vector<string> & missing_deps_out,
-					     progress_printer & pprinter )
+					     vector<vector<string> > & cycle_groups_out,
+					     unsigned int jobs,
+					     progress_printer & pprinter,
+					     resolved_package_graph * graph_out )
   {
+    static stat_phase sort_phase( "flatten_sort_packages" );
+    static stat_phase levels_phase( "scc + levels" );
+    scoped_timer timer( sort_phase );
+    dep_graph graph = build_package_graph( rpms_to_resolve, installed_db,
+					   missing_deps_out, pprinter, NULL,
+					   graph_out != NULL ?
+					   &graph_out->edge_requires : NULL );
+
     vector<resolvedrpm> retval;
-    unordered_map<string,reference_wrapper<resolvedrpm> > pid_to_package;
-    unordered_map<string,reference_wrapper<resolvedrpm> > provides_to_package;
     for( installedrpm & irpm : rpms_to_resolve ) {
-      string rpm_name = irpm.get_name();
       retval.emplace_back( irpm, 0 );
     }
 
-    // Now things are stable in memory, build the maps
-    for( resolvedrpm & rrpm : retval ) {
-      string rpm_name = rrpm.get_package().get_name();
-      pid_to_package.emplace(rpm_name, rrpm);
-      provides_to_package.emplace(rpm_name, rrpm);
-      for( const string & provide : rrpm.get_package().get_provides() ) {
-	provides_to_package.emplace(provide, rrpm);
-	//	cout << "RPM " << rpm_name << " provides " << provide << endl;
+    // Cycles are condensed into a single component so each member gets
+    // the same sequence number regardless of where the walk started.
+    optional<scoped_timer> levels_timer;
+    levels_timer.emplace( levels_phase );
+    dep_graph_sccs sccs( graph );
+    vector<uint32_t> component_levels;
+    compute_component_levels( graph, sccs, jobs, component_levels );
+    levels_timer.reset();
+
+    assign_sequence_numbers( retval, sccs, component_levels,
+			     cycle_groups_out );
+
+    mark_special_packages( retval, graph, special_strategy );
+
+    sort_resolved_packages( retval );
+
+    if( graph_out != NULL ) {
+      graph_out->packages.resize( rpms_to_resolve.size() );
+      for( uint32_t idx = 0 ; idx < rpms_to_resolve.size() ; ++idx ) {
+	graph_out->packages[idx] = idx;
       }
+      graph_out->graph = std::move(graph);
     }
 
-    unordered_set<string> done_packages;
-
-    // First pass, only "special" packages
-    for( resolvedrpm & pkg : retval ) {
-      const string & pkg_name = pkg.get_package().get_name();
-      if( special_strategy(pkg_name) ) {
-	vector<string> pkg_resolution_stack;
-	//      cout << "do erfp on " << pkg.get_package().get_name() << endl;
-	recursive_flatten_deps( missing_deps_out,
-				pkg,
-				retval,
-				pid_to_package,
-				provides_to_package,
-				done_packages,
-				pkg,
-				pkg_resolution_stack,
-				special_strategy,
-				true, // by default, special parent
-				pprinter );
-	pprinter.accept_progress();
+    pprinter.reset();
+
+    return retval;
+  }
+
+  vector<resolvedrpm> closure_sort_packages( const vector<installedrpm> & rpms_to_resolve,
+					     const installed_db_snapshot & installed_db,
+					     const function<bool (const string&)> & special_strategy,
+					     vector<string> & missing_deps_out,
+					     vector<vector<string> > & cycle_groups_out,
+					     unsigned int jobs,
+					     progress_printer & pprinter,
+					     resolved_package_graph * graph_out )
+  {
+    static stat_phase closure_phase( "closure_sort_packages" );
+    static stat_counter reached_counter( "closure packages reached" );
+    scoped_timer timer( closure_phase );
+
+    // Names and provides are indexed up front; requires are only
+    // resolved once the walk reaches their package
+    package_resolver resolver( rpms_to_resolve, installed_db );
+
+    // Reached packages get closure-local numbers in visit order
+    vector<uint32_t> reached;
+    unordered_map<uint32_t,uint32_t> package_to_node;
+    auto reach = [&]( uint32_t idx ) -> uint32_t {
+      auto inserted = package_to_node.emplace( idx, reached.size() );
+      if( inserted.second ) {
+	reached.push_back( idx );
+      }
+      return inserted.first->second;
+    };
+    for( uint32_t idx = 0 ; idx < rpms_to_resolve.size() ; ++idx ) {
+      if( special_strategy(rpms_to_resolve[idx].get_name()) ) {
+	reach( idx );
       }
     }
 
-
-    // Second pass, non "special"
-    for( resolvedrpm & pkg : retval ) {
-      vector<string> pkg_resolution_stack;
-      //      cout << "do erfp on " << pkg.get_package().get_name() << endl;
-      recursive_flatten_deps( missing_deps_out,
-			      pkg,
-			      retval,
-			      pid_to_package,
-			      provides_to_package,
-			      done_packages,
-			      pkg,
-			      pkg_resolution_stack,
-			      special_strategy,
-			      false, // by default, no special parent
-			      pprinter );
+    vector<pair<uint32_t,uint32_t>> edge_pairs;
+    vector<uint32_t> edge_require_ids;
+    for( uint32_t node = 0 ; node < reached.size() ; ++node ) {
+      const installedrpm & package = rpms_to_resolve[reached[node]];
+      for( uint32_t require_id : resolver.get_requires( reached[node] ) ) {
+	uint32_t provider = resolver.find_provider( require_id );
+	if( provider == no_package ) {
+	  stringstream missing_deps_buf;
+	  missing_deps_buf << "Package " << package.get_name() <<
+	    " has missing requires: " << resolver.get_string( require_id );
+	  missing_deps_out.push_back(missing_deps_buf.str());
+	  continue;
+	}
+	uint32_t provider_node = reach( provider );
+	if( provider_node != node ) {
+	  edge_pairs.emplace_back( node, provider_node );
+	  if( graph_out != NULL ) {
+	    edge_require_ids.push_back( require_id );
+	  }
+	}
+      }
       pprinter.accept_progress();
     }
+    reached_counter.add( reached.size() );
 
-    std::sort(retval.begin(),retval.end(),
-	      []( const resolvedrpm & a, const resolvedrpm & b ) -> bool {
-		// Sort them by sequenceNumber, then by name
-		// (to ensure stable results)
-		if( a.get_sequence_no() == b.get_sequence_no() ) {
-		  return a.get_package().get_name() < b.get_package().get_name();
-		}
-		else {
-		  return a.get_sequence_no() < b.get_sequence_no();
-		}
-	      });
+    vector<pair<uint32_t,uint32_t>> labelled_pairs;
+    if( graph_out != NULL ) {
+      labelled_pairs = edge_pairs;
+    }
+    dep_graph graph( reached.size(), edge_pairs );
+    vector<resolvedrpm> retval;
+    for( uint32_t idx : reached ) {
+      retval.emplace_back( rpms_to_resolve[idx], 0 );
+      retval.back().set_special( true );
+    }
+
+    dep_graph_sccs sccs( graph );
+    vector<uint32_t> component_levels;
+    compute_component_levels( graph, sccs, jobs, component_levels );
+    assign_sequence_numbers( retval, sccs, component_levels,
+			     cycle_groups_out );
+
+    sort_resolved_packages( retval );
+
+    if( graph_out != NULL ) {
+      label_edges( graph, labelled_pairs,
+		   [&]( size_t i ) -> const string & {
+		     return resolver.get_string( edge_require_ids[i] );
+		   },
+		   graph_out->edge_requires );
+      graph_out->packages = reached;
+      graph_out->graph = std::move(graph);
+    }
 
     pprinter.reset();
 
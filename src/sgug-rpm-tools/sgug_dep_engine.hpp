@@ -3,6 +3,8 @@
 
 #include "helpers.hpp"
 #include "installedrpm.hpp"
+#include "installeddb.hpp"
+#include "depgraph.hpp"
 
 #include <vector>
 #include <functional>
@@ -31,10 +33,64 @@ namespace sgug_rpm {
   
   };
 
+  // Resolve each package's requires to the index (in packages) of the
+  // providing package. Requires not satisfied by packages itself are
+  // looked up in installed_db's file and provide indexes; those that
+  // still don't resolve are reported in missing_deps_out, and when
+  // missing_dep_packages_out is passed the index of the package each
+  // one belongs to goes alongside. edge_requires_out, when passed, gets
+  // the (first) require behind each edge, lined up with the graph's
+  // get_edge_array().
+  dep_graph build_package_graph( const std::vector<installedrpm> & packages,
+				 const installed_db_snapshot & installed_db,
+				 std::vector<std::string> & missing_deps_out,
+				 progress_printer & pprinter,
+				 std::vector<uint32_t> * missing_dep_packages_out = NULL,
+				 std::vector<std::string> * edge_requires_out = NULL );
+
+  // The graph a sort resolved, handed back so later queries (require
+  // chains, footprints) don't have to resolve everything again. Node n
+  // is rpms_to_resolve[packages[n]].
+  struct resolved_package_graph {
+    std::vector<uint32_t> packages;
+    dep_graph graph;
+    // The require behind each edge, lined up with get_edge_array()
+    std::vector<std::string> edge_requires;
+  };
+
+  // The packages (with everything they require) a minimal install keeps
+  std::vector<std::string> default_special_packages();
+
+  // Sequence numbers are the longest require chain (in strongly connected
+  // components) below each package, so a package always sorts after what
+  // it requires. Requires not satisfied by the packages being resolved are
+  // looked up in installed_db's file and provide indexes. Each dependency
+  // cycle found is reported as a sorted group of package names. With
+  // jobs > 1 the levels of large package sets are computed across
+  // threads; the result is the same as with a single job. The graph,
+  // over all of rpms_to_resolve, goes to graph_out when passed.
   std::vector<resolvedrpm> flatten_sort_packages( std::vector<installedrpm> & rpms_to_resolve,
+						  const installed_db_snapshot & installed_db,
+						  const std::function<bool (const std::string&)> & special_strategy,
+						  std::vector<std::string> & missing_deps_out,
+						  std::vector<std::vector<std::string> > & cycle_groups_out,
+						  unsigned int jobs,
+						  progress_printer & pprinter,
+						  resolved_package_graph * graph_out = NULL );
+
+  // The special packages of flatten_sort_packages alone, without
+  // touching the rest: a walk from the packages special_strategy picks
+  // resolves requires only as it reaches them, and only what it reached
+  // is sequenced. Missing requires and cycles are those of the reached
+  // packages, and graph_out (when passed) only holds those.
+  std::vector<resolvedrpm> closure_sort_packages( const std::vector<installedrpm> & rpms_to_resolve,
+						  const installed_db_snapshot & installed_db,
 						  const std::function<bool (const std::string&)> & special_strategy,
 						  std::vector<std::string> & missing_deps_out,
-						  progress_printer & pprinter );
+						  std::vector<std::vector<std::string> > & cycle_groups_out,
+						  unsigned int jobs,
+						  progress_printer & pprinter,
+						  resolved_package_graph * graph_out = NULL );
 }
 
 #endif
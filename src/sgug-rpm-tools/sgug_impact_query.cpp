@@ -0,0 +1,254 @@
+#include "helpers.hpp"
+#include "installedrpm.hpp"
+#include "installeddb.hpp"
+#include "installeddbcache.hpp"
+#include "packagesource.hpp"
+#include "depclosure.hpp"
+#include "sgug_dep_engine.hpp"
+#include "runstats.hpp"
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <rpm/rpmcli.h>
+#include <rpm/rpmlog.h>
+
+// C++ structures/algorithms
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using std::cerr;
+using std::cin;
+using std::cout;
+using std::endl;
+using std::string;
+using std::stringstream;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+static int union_queries = 0;
+static int read_stdin = 0;
+static char * dbcachefile = NULL;
+static int no_dbcache = 0;
+static char * fixturefile = NULL;
+
+static struct poptOption optionsTable[] = {
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
+    "Common options for all rpm modes and executables",
+    NULL },
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, sgug_rpm::runStatsPoptTable, 0,
+    "Instrumentation options",
+    NULL },
+  {
+    "union",
+    'u',
+    POPT_ARG_NONE,
+    &union_queries,
+    0,
+    "Treat all packages on the command line as a single query",
+    NULL
+  },
+  {
+    "stdin",
+    's',
+    POPT_ARG_NONE,
+    &read_stdin,
+    0,
+    "Also answer queries read from stdin, one per line (space separated package names)",
+    NULL
+  },
+  {
+    "dbcache",
+    '\0',
+    POPT_ARG_STRING,
+    &dbcachefile,
+    0,
+    "Installed package cache file (default ~/.cache/sgug-rpm-tools/installeddb.bin)",
+    "FILE"
+  },
+  {
+    "nodbcache",
+    '\0',
+    POPT_ARG_NONE,
+    &no_dbcache,
+    0,
+    "Always read installed packages from the rpmdb, ignoring the installed package cache",
+    NULL
+  },
+  {
+    "fixture",
+    '\0',
+    POPT_ARG_STRING,
+    &fixturefile,
+    0,
+    "Read installed packages from a fixture file instead of the rpmdb",
+    "FILE"
+  },
+  POPT_AUTOALIAS
+  POPT_AUTOHELP
+  POPT_TABLEEND
+};
+
+class impact_query_engine {
+  const vector<sgug_rpm::installedrpm> & _packages;
+  unordered_map<string,uint32_t> _name_to_node;
+  sgug_rpm::reverse_closure_index _closures;
+
+public:
+  impact_query_engine( const vector<sgug_rpm::installedrpm> & packages,
+		       const sgug_rpm::dep_graph & graph )
+    : _packages(packages),
+      _closures(graph) {
+    for( uint32_t node = 0 ; node < packages.size() ; ++node ) {
+      // Multiple installs of a name: last one wins, as with the snapshot
+      _name_to_node[packages[node].get_name()] = node;
+    }
+  }
+
+  size_t get_num_components() const { return _closures.get_num_components(); };
+
+  // Prints everything else affected by the named packages. Returns false
+  // if any of them isn't installed.
+  bool answer( const vector<string> & names ) {
+    bool retval = true;
+    vector<uint32_t> nodes;
+    unordered_set<uint32_t> queried;
+    for( const string & name : names ) {
+      auto finder = _name_to_node.find( name );
+      if( finder == _name_to_node.end() ) {
+	cerr << "Package " << name << " is not installed" << endl;
+	retval = false;
+	continue;
+      }
+      nodes.push_back( finder->second );
+      queried.insert( finder->second );
+    }
+
+    vector<uint32_t> closure;
+    _closures.query( nodes, closure );
+
+    vector<string> affected;
+    for( uint32_t node : closure ) {
+      if( queried.find(node) == queried.end() ) {
+	affected.push_back( _packages[node].get_name() );
+      }
+    }
+    std::sort( affected.begin(), affected.end() );
+    affected.erase( std::unique( affected.begin(), affected.end() ),
+		    affected.end() );
+
+    cout << "# Impact of";
+    for( const string & name : names ) {
+      cout << " " << name;
+    }
+    cout << ": " << affected.size() << " package(s)" << endl;
+    for( const string & name : affected ) {
+      cout << name << endl;
+    }
+    return retval;
+  }
+};
+
+int main(int argc, char**argv)
+{
+  sgug_rpm::poptcontext_h popt_context( argc, argv, optionsTable );
+  rpmlogSetMask(RPMLOG_ERR);
+
+  if( popt_context.context == NULL ) {
+    exit(EXIT_FAILURE);
+  }
+
+  vector<string> query_names;
+  const char ** fnp;
+  for( fnp = poptGetArgs(popt_context.context); fnp && *fnp; ++fnp ) {
+    query_names.push_back(*fnp);
+  }
+
+  if( query_names.size() == 0 && !read_stdin ) {
+    cerr << "Pass the package(s) to query, or --stdin" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  bool verbose = popt_context.verbose;
+
+  std::unique_ptr<sgug_rpm::package_source> source =
+    sgug_rpm::open_package_source( popt_context, fixturefile );
+  if( !source ) {
+    exit(EXIT_FAILURE);
+  }
+  // Fixtures never touch the default cache, only one asked for
+  bool use_dbcache = !no_dbcache &&
+    (fixturefile == NULL || dbcachefile != NULL);
+
+  sgug_rpm::progress_printer pprinter;
+
+  cout << "# Loading installed packages..." << endl;
+
+  sgug_rpm::installed_db_snapshot installed_db;
+  sgug_rpm::installed_db_cache dbcache( dbcachefile != NULL ?
+					string(dbcachefile) :
+					sgug_rpm::default_installed_db_cache_path(),
+					source->get_installed_fingerprint() );
+  sgug_rpm::load_installed_db( *source,
+			       verbose,
+			       use_dbcache ? &dbcache : NULL,
+			       installed_db,
+			       pprinter );
+
+  const vector<sgug_rpm::installedrpm> & packages = installed_db.get_packages();
+  vector<string> missing_deps;
+  sgug_rpm::dep_graph graph;
+  // The graph over everything installed is saved alongside the snapshot
+  if( !use_dbcache || !dbcache.load_graph( graph, missing_deps ) ) {
+    graph = sgug_rpm::build_package_graph( packages, installed_db,
+					   missing_deps, pprinter );
+    pprinter.reset();
+    if( use_dbcache ) {
+      dbcache.save( installed_db, &graph, &missing_deps );
+    }
+  }
+  if( verbose ) {
+    for( const string & missing_dep : missing_deps ) {
+      cout << "# " << missing_dep << endl;
+    }
+  }
+
+  impact_query_engine engine( packages, graph );
+  cout << "# Loaded " << packages.size() << " package(s) in " <<
+    engine.get_num_components() << " component(s)" << endl;
+
+  bool all_ok = true;
+  if( union_queries ) {
+    if( query_names.size() > 0 ) {
+      all_ok = engine.answer( query_names ) && all_ok;
+    }
+  }
+  else {
+    for( const string & name : query_names ) {
+      all_ok = engine.answer( vector<string>{ name } ) && all_ok;
+    }
+  }
+
+  if( read_stdin ) {
+    for( string line; std::getline(cin, line); ) {
+      stringstream line_buf( line );
+      vector<string> names;
+      for( string name; line_buf >> name; ) {
+	names.push_back( name );
+      }
+      if( names.size() > 0 ) {
+	all_ok = engine.answer( names ) && all_ok;
+      }
+    }
+  }
+
+  sgug_rpm::report_run_stats();
+
+  return all_ok ? 0 : 1;
+}
@@ -1,12 +1,23 @@
 #include "helpers.hpp"
 #include "specfile.hpp"
+#include "speccache.hpp"
 #include "installedrpm.hpp"
+#include "installeddb.hpp"
+#include "installeddbcache.hpp"
+#include "packagesource.hpp"
 #include "dependencyset.hpp"
+#include "requirepaths.hpp"
 #include "sgug_dep_engine.hpp"
+#include "bufferedoutput.hpp"
+#include "depclosure.hpp"
+#include "depdominators.hpp"
+#include "rootprofiles.hpp"
+#include "runstats.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <memory>
 #include <optional>
 
 #include <rpm/rpmcli.h>
@@ -27,7 +38,7 @@ using std::cerr;
 using std::cout;
 using std::endl;
 using std::optional;
-using std::ofstream;
+using std::pair;
 using std::string;
 using std::unordered_map;
 using std::unordered_set;
@@ -38,12 +49,29 @@ using std::filesystem::path;
 namespace fs = std::filesystem;
 
 static char * gitrootdir = NULL;
+static int jobs = 1;
+static char * speccachefile = NULL;
+static int no_speccache = 0;
+static int refresh_speccache = 0;
+static char * dbcachefile = NULL;
+static int no_dbcache = 0;
+static char * fixturefile = NULL;
+static char * dumpfixturefile = NULL;
+static int closure_only = 0;
+static char * profilesfile = NULL;
+static int footprint = 0;
+static char * why_package = NULL;
+static int why_chains = 3;
 
 static struct poptOption optionsTable[] = {
   {
     NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
     "Common options for all rpm modes and executables",
     NULL },
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, sgug_rpm::runStatsPoptTable, 0,
+    "Instrumentation options",
+    NULL },
   {
     "gitroot",
     'g',
@@ -53,21 +81,435 @@ static struct poptOption optionsTable[] = {
     "RSE git repository directory containing releasepackages.lst",
     NULL
   },
+  {
+    "jobs",
+    'j',
+    POPT_ARG_INT,
+    &jobs,
+    0,
+    "Number of parallel workers used to parse specs and order packages",
+    "N"
+  },
+  {
+    "speccache",
+    '\0',
+    POPT_ARG_STRING,
+    &speccachefile,
+    0,
+    "Spec parse cache file (default ~/.cache/sgug-rpm-tools/speccache.bin)",
+    "FILE"
+  },
+  {
+    "nospeccache",
+    '\0',
+    POPT_ARG_NONE,
+    &no_speccache,
+    0,
+    "Always parse every spec file, ignoring the spec parse cache",
+    NULL
+  },
+  {
+    "refreshspeccache",
+    '\0',
+    POPT_ARG_NONE,
+    &refresh_speccache,
+    0,
+    "Parse every spec file again and rewrite the spec parse cache",
+    NULL
+  },
+  {
+    "dbcache",
+    '\0',
+    POPT_ARG_STRING,
+    &dbcachefile,
+    0,
+    "Installed package cache file (default ~/.cache/sgug-rpm-tools/installeddb.bin)",
+    "FILE"
+  },
+  {
+    "nodbcache",
+    '\0',
+    POPT_ARG_NONE,
+    &no_dbcache,
+    0,
+    "Always read installed packages from the rpmdb, ignoring the installed package cache",
+    NULL
+  },
+  {
+    "fixture",
+    '\0',
+    POPT_ARG_STRING,
+    &fixturefile,
+    0,
+    "Read installed packages and specs from a fixture file instead of the rpmdb and librpm",
+    "FILE"
+  },
+  {
+    "closure",
+    '\0',
+    POPT_ARG_NONE,
+    &closure_only,
+    0,
+    "Only resolve and order packages reachable from the minimal set; removeexisting.sh lists the rest by name",
+    NULL
+  },
+  {
+    "profiles",
+    '\0',
+    POPT_ARG_STRING,
+    &profilesfile,
+    0,
+    "Compute the minimal set of every [profile] in FILE, each into a directory named after it",
+    "FILE"
+  },
+  {
+    "footprint",
+    '\0',
+    POPT_ARG_NONE,
+    &footprint,
+    0,
+    "Also write footprint.txt: the packages and installed bytes only each kept package keeps",
+    NULL
+  },
+  {
+    "why",
+    '\0',
+    POPT_ARG_STRING,
+    &why_package,
+    0,
+    "Print the shortest require chains from the minimal set down to PACKAGE",
+    "PACKAGE"
+  },
+  {
+    "chains",
+    '\0',
+    POPT_ARG_INT,
+    &why_chains,
+    0,
+    "Number of chains --why prints (default 3)",
+    "N"
+  },
+  {
+    "dumpfixture",
+    '\0',
+    POPT_ARG_STRING,
+    &dumpfixturefile,
+    0,
+    "Write the installed packages and parsed specs to a fixture file",
+    "FILE"
+  },
   POPT_AUTOALIAS
   POPT_AUTOHELP
   POPT_TABLEEND
 };
 
-optional<string> calculate_expected_specfile_path( string sgug_rse_git_root,
-					 string package_name ) {
-  path srgr_path = std::filesystem::path(sgug_rse_git_root);
-  path package_spec_path = srgr_path / "packages" / package_name / "SPECS" / (package_name + ".spec");
-  if( fs::exists(package_spec_path) ) {
-    return {fs::canonical(package_spec_path)};
+// missingdeps.txt, cyclegroups.txt, leaveinstalled.txt (the special
+// packages) and removeexisting.sh (the rest) for resolved_rpms, which
+// are in sequence order, written into outdir
+static bool write_minimal_set_outputs( const path & outdir,
+				       vector<sgug_rpm::resolvedrpm> & resolved_rpms,
+				       const vector<string> & missing_deps,
+				       const vector<vector<string> > & cycle_groups ) {
+  sgug_rpm::buffered_output_file missingdepsfile( outdir / "missingdeps.txt" );
+  for( auto & md : missing_deps ) {
+    missingdepsfile << md << "\n";
   }
-  else {
-    return {};
+
+  // One cycle per line, every member gets the same sequence number
+  sgug_rpm::buffered_output_file cyclegroupsfile( outdir / "cyclegroups.txt" );
+  for( auto & cycle_group : cycle_groups ) {
+    for( size_t i = 0 ; i < cycle_group.size() ; ++i ) {
+      cyclegroupsfile << (i > 0 ? " " : "") << cycle_group[i];
+    }
+    cyclegroupsfile << "\n";
+  }
+
+  sgug_rpm::buffered_output_file leaveinstalledfile( outdir / "leaveinstalled.txt" );
+
+  sgug_rpm::buffered_output_file removeexistingfile( outdir / "removeexisting.sh" );
+  removeexistingfile << "#!/usr/sgug/bin/bash\n";
+  removeexistingfile << "# This script should be run under sudo!\n";
+  removeexistingfile << "# (and may not work properly due to perl circular " \
+    "dependencies)\n";
+
+  // Leave installed we have in the order from least-deps to most-deps,
+  // while for remove existing we walk backwards to easier remove. Each
+  // package to remove gets a comment line and goes on one big fat long
+  // rpm line at the end (it's quicker/more correct to get rpm to do it
+  // all at once), so both are built in the same single backwards pass.
+  string remove_command;
+  for( auto rrpm_it = resolved_rpms.rbegin() ; rrpm_it != resolved_rpms.rend() ; ++rrpm_it ) {
+    if( !rrpm_it->get_special() ) {
+      const sgug_rpm::installedrpm & package = rrpm_it->get_package();
+      removeexistingfile << "# Should remove " << package.get_name() <<
+	" " << package.get_rpmfile() << "\n";
+      remove_command += " " + package.get_name();
+    }
   }
+  if( !remove_command.empty() ) {
+    removeexistingfile << "rpm -evh" << remove_command << "\n";
+  }
+  for( sgug_rpm::resolvedrpm & rrpm : resolved_rpms ) {
+    if( rrpm.get_special() ) {
+      leaveinstalledfile << rrpm.get_package().get_name() << " " <<
+	rrpm.get_package().get_rpmfile() << "\n";
+    }
+  }
+
+  // All four are on disk before any replaces the last run's, and the
+  // destructive script is renamed last
+  return sgug_rpm::commit_together( { &missingdepsfile,
+				      &cyclegroupsfile,
+				      &leaveinstalledfile,
+				      &removeexistingfile } );
+}
+
+// footprint.txt in outdir: for every component of the condensed graph
+// reached from root_nodes, the number of packages and installed bytes
+// it dominates - what dropping it would let go - heaviest first. The
+// root nodes hang off a virtual root, so a root's figures are what it
+// alone keeps. Cycle members can only go together and share one line.
+// Node n of the graph is packages[node_packages[n]].
+static bool write_footprint( const path & outdir,
+			     const vector<sgug_rpm::installedrpm> & packages,
+			     const vector<uint32_t> & node_packages,
+			     const sgug_rpm::dep_graph_sccs & sccs,
+			     const sgug_rpm::dep_graph & components,
+			     const vector<uint32_t> & root_nodes ) {
+  uint32_t virtual_root = components.get_num_nodes();
+  vector<uint32_t> root_components;
+  for( uint32_t node : root_nodes ) {
+    root_components.push_back( sccs.get_component(node) );
+  }
+  std::sort( root_components.begin(), root_components.end() );
+  root_components.erase( std::unique( root_components.begin(),
+				      root_components.end() ),
+			 root_components.end() );
+  vector<uint32_t> offsets = components.get_offsets();
+  vector<uint32_t> edges = components.get_edge_array();
+  edges.insert( edges.end(), root_components.begin(), root_components.end() );
+  offsets.push_back( edges.size() );
+  sgug_rpm::dominator_tree dominators( sgug_rpm::dep_graph( std::move(offsets),
+							    std::move(edges) ),
+				       virtual_root );
+
+  vector<uint64_t> counts( virtual_root + 1, 0 ), sizes( virtual_root + 1, 0 );
+  for( uint32_t component = 0 ; component < virtual_root ; ++component ) {
+    for( uint32_t member : sccs.get_members(component) ) {
+      counts[component]++;
+      sizes[component] += packages[node_packages[member]].get_size();
+    }
+  }
+  vector<uint64_t> dominated_counts, dominated_sizes;
+  dominators.sum_dominated( counts, dominated_counts );
+  dominators.sum_dominated( sizes, dominated_sizes );
+
+  struct footprint_line {
+    string names;
+    uint64_t count;
+    uint64_t size;
+  };
+  vector<footprint_line> lines;
+  for( uint32_t component = 0 ; component < virtual_root ; ++component ) {
+    if( !dominators.is_reachable( component ) ) {
+      continue;
+    }
+    vector<string> names;
+    for( uint32_t member : sccs.get_members(component) ) {
+      names.push_back( packages[node_packages[member]].get_name() );
+    }
+    std::sort( names.begin(), names.end() );
+    string joined;
+    for( const string & name : names ) {
+      joined += (joined.empty() ? "" : ",") + name;
+    }
+    lines.push_back( footprint_line{ joined, dominated_counts[component],
+				     dominated_sizes[component] } );
+  }
+  std::sort( lines.begin(), lines.end(),
+	     []( const footprint_line & a, const footprint_line & b ) -> bool {
+	       if( a.size != b.size ) {
+		 return a.size > b.size;
+	       }
+	       if( a.count != b.count ) {
+		 return a.count > b.count;
+	       }
+	       return a.names < b.names;
+	     });
+
+  sgug_rpm::buffered_output_file footprintfile( outdir / "footprint.txt" );
+  footprintfile << "# package(s) dominated-packages dominated-bytes\n";
+  for( const footprint_line & line : lines ) {
+    footprintfile << line.names << " " << line.count << " " << line.size <<
+      "\n";
+  }
+  return footprintfile.commit();
+}
+
+// Each chain on one line, root first, with the require that pulled in
+// every further package in brackets
+static void print_require_chains( const string & package_name,
+				  const vector<sgug_rpm::installedrpm> & packages,
+				  const sgug_rpm::resolved_package_graph & resolved,
+				  const vector<uint32_t> & root_nodes,
+				  size_t max_chains ) {
+  bool installed = false;
+  for( const sgug_rpm::installedrpm & package : packages ) {
+    installed = installed || package.get_name() == package_name;
+  }
+  if( !installed ) {
+    cout << "# " << package_name << " isn't installed" << endl;
+    return;
+  }
+  auto node_name = [&]( uint32_t node ) -> const string & {
+    return packages[resolved.packages[node]].get_name();
+  };
+  const sgug_rpm::dep_graph & graph = resolved.graph;
+  sgug_rpm::require_paths paths( graph, root_nodes );
+  uint32_t target = resolved.packages.size();
+  for( uint32_t node = 0 ; node < resolved.packages.size() ; ++node ) {
+    if( node_name(node) == package_name ) {
+      target = node;
+    }
+  }
+  if( target == resolved.packages.size() || !paths.is_reached( target ) ) {
+    cout << "# " << package_name << " isn't kept by the minimal set" << endl;
+    return;
+  }
+  vector<vector<uint32_t> > chains;
+  paths.find_chains( target, max_chains, chains );
+  cout << "# " << package_name << " is " << paths.get_depth( target ) <<
+    " require(s) from the minimal set, " << chains.size() <<
+    " chain(s):" << endl;
+  const vector<uint32_t> & offsets = graph.get_offsets();
+  const vector<uint32_t> & edges = graph.get_edge_array();
+  for( const vector<uint32_t> & chain : chains ) {
+    string line = node_name( chain[0] );
+    for( size_t i = 1 ; i < chain.size() ; ++i ) {
+      auto position = std::lower_bound( edges.begin() + offsets[chain[i - 1]],
+					edges.begin() + offsets[chain[i - 1] + 1],
+					chain[i] );
+      line += " -> " + node_name( chain[i] ) +
+	" [" + resolved.edge_requires[position - edges.begin()] + "]";
+    }
+    cout << line << endl;
+  }
+}
+
+// Every profile's outputs into a directory named after it. The graph,
+// its components and their levels are computed once for all of them,
+// and closures are memoised per component, so each further profile
+// costs little more than writing its files.
+static bool write_profile_outputs( const vector<sgug_rpm::root_profile> & profiles,
+				   vector<sgug_rpm::installedrpm> & rpms_to_resolve,
+				   const sgug_rpm::installed_db_snapshot & installed_db,
+				   unsigned int num_jobs,
+				   sgug_rpm::progress_printer & pprinter ) {
+  vector<string> missing_deps;
+  vector<uint32_t> missing_dep_packages;
+  sgug_rpm::dep_graph graph =
+    sgug_rpm::build_package_graph( rpms_to_resolve, installed_db,
+				   missing_deps, pprinter,
+				   &missing_dep_packages );
+  pprinter.reset();
+  sgug_rpm::forward_closure_index closures( graph );
+  const sgug_rpm::dep_graph_sccs & sccs = closures.get_sccs();
+  vector<uint32_t> component_levels;
+  sgug_rpm::compute_component_levels( graph, sccs, num_jobs,
+				      component_levels );
+
+  // The same (sequence number, name) order flatten_sort_packages gives
+  vector<uint32_t> ordered_nodes( rpms_to_resolve.size() );
+  for( uint32_t node = 0 ; node < ordered_nodes.size() ; ++node ) {
+    ordered_nodes[node] = node;
+  }
+  auto node_level = [&]( uint32_t node ) -> uint32_t {
+    return component_levels[sccs.get_component(node)];
+  };
+  std::sort( ordered_nodes.begin(), ordered_nodes.end(),
+	     [&]( uint32_t a, uint32_t b ) -> bool {
+	       if( node_level(a) == node_level(b) ) {
+		 return rpms_to_resolve[a].get_name() < rpms_to_resolve[b].get_name();
+	       }
+	       return node_level(a) < node_level(b);
+	     });
+  vector<sgug_rpm::resolvedrpm> resolved_rpms;
+  for( uint32_t node : ordered_nodes ) {
+    resolved_rpms.emplace_back( rpms_to_resolve[node], node_level(node) );
+  }
+
+  vector<pair<uint32_t,vector<string> > > component_cycle_groups;
+  for( uint32_t component = 0 ; component < sccs.get_num_components() ; ++component ) {
+    const vector<uint32_t> & members = sccs.get_members(component);
+    if( members.size() > 1 ) {
+      vector<string> cycle_group;
+      for( uint32_t member : members ) {
+	cycle_group.push_back( rpms_to_resolve[member].get_name() );
+      }
+      std::sort( cycle_group.begin(), cycle_group.end() );
+      component_cycle_groups.emplace_back( component, cycle_group );
+    }
+  }
+
+  unordered_map<string,uint32_t> name_to_node;
+  // The graph's nodes are the packages themselves
+  vector<uint32_t> node_packages( rpms_to_resolve.size() );
+  for( uint32_t node = 0 ; node < rpms_to_resolve.size() ; ++node ) {
+    name_to_node.emplace( rpms_to_resolve[node].get_name(), node );
+    node_packages[node] = node;
+  }
+
+  for( const sgug_rpm::root_profile & profile : profiles ) {
+    vector<uint32_t> root_nodes;
+    for( const string & root : profile.roots ) {
+      auto finder = name_to_node.find( root );
+      if( finder == name_to_node.end() ) {
+	cout << "# Profile " << profile.name << ": " << root <<
+	  " isn't installed" << endl;
+	continue;
+      }
+      root_nodes.push_back( finder->second );
+    }
+    sgug_rpm::dep_bitset kept = closures.query_components( root_nodes );
+
+    size_t num_kept = 0;
+    for( size_t idx = 0 ; idx < resolved_rpms.size() ; ++idx ) {
+      bool special = kept.test( sccs.get_component(ordered_nodes[idx]) );
+      resolved_rpms[idx].set_special( special );
+      num_kept += special ? 1 : 0;
+    }
+    vector<string> profile_missing_deps;
+    for( size_t idx = 0 ; idx < missing_deps.size() ; ++idx ) {
+      if( kept.test( sccs.get_component(missing_dep_packages[idx]) ) ) {
+	profile_missing_deps.push_back( missing_deps[idx] );
+      }
+    }
+    vector<vector<string> > profile_cycle_groups;
+    for( auto & component_cycle_group : component_cycle_groups ) {
+      if( kept.test( component_cycle_group.first ) ) {
+	profile_cycle_groups.push_back( component_cycle_group.second );
+      }
+    }
+    std::sort( profile_cycle_groups.begin(), profile_cycle_groups.end() );
+
+    path outdir = path(profile.name);
+    std::error_code ec;
+    fs::create_directories( outdir, ec );
+    cout << "# Profile " << profile.name << ": keeps " << num_kept <<
+      " of " << resolved_rpms.size() << " rpm(s), see " << outdir << "/" <<
+      endl;
+    if( ec || !write_minimal_set_outputs( outdir, resolved_rpms,
+					  profile_missing_deps,
+					  profile_cycle_groups ) ||
+	(footprint && !write_footprint( outdir, rpms_to_resolve,
+					node_packages, sccs,
+					closures.get_component_graph(),
+					root_nodes )) ) {
+      cerr << "Unable to write profile " << profile.name << endl;
+      return false;
+    }
+  }
+  return true;
 }
 
 int main(int argc, char**argv)
@@ -98,6 +540,16 @@ int main(int argc, char**argv)
 
   bool verbose = popt_context.verbose;
 
+  std::unique_ptr<sgug_rpm::package_source> source =
+    sgug_rpm::open_package_source( popt_context, fixturefile );
+  if( !source ) {
+    exit(EXIT_FAILURE);
+  }
+  // Fixtures never touch the default caches, only ones asked for
+  bool use_speccache = !no_speccache && fixturefile == NULL;
+  bool use_dbcache = !no_dbcache &&
+    (fixturefile == NULL || dbcachefile != NULL);
+
   sgug_rpm::progress_printer pprinter;
 
   cout << "# Reading spec files..." << endl;
@@ -119,10 +571,12 @@ int main(int argc, char**argv)
   }
   input.close();
 
+  vector<string> spec_paths;
+  // Failures come back as spec paths, but are reported by package name
+  unordered_map<string,string> spec_path_names;
   for( string & package_name : names_in ) {
     optional<string> expected_specfile_path_opt =
-      calculate_expected_specfile_path( gitrootdir_p,
-					package_name );
+      source->find_specfile( gitrootdir_p, package_name );
     if( !expected_specfile_path_opt ) {
       cerr << "Missing spec for " << package_name << endl;
       cerr << "Looked under " << gitrootdir_p << "/packages/" <<
@@ -130,22 +584,35 @@ int main(int argc, char**argv)
       exit(EXIT_FAILURE);
     }
     string expected_specfile_path = *expected_specfile_path_opt;
-    sgug_rpm::specfile specfile;
     if( verbose ) {
       cout << "# Checking for spec at " << expected_specfile_path << endl;
     }
-    rpmSpecFlags flags = (RPMSPEC_FORCE);
-    if( sgug_rpm::read_specfile( expected_specfile_path,
-				 flags,
-				 specfile,
-				 pprinter ) ) {
-      valid_specfiles.emplace_back( specfile );
-    }
-    else {
-      failed_specfiles.push_back( package_name );
+    spec_paths.push_back( expected_specfile_path );
+    spec_path_names.emplace( expected_specfile_path, package_name );
+  }
+
+  rpmSpecFlags flags = (RPMSPEC_FORCE);
+  sgug_rpm::specfile_cache speccache( speccachefile != NULL ?
+				      string(speccachefile) :
+				      sgug_rpm::default_speccache_path(),
+				      sgug_rpm::compute_spec_macro_fingerprint(flags) );
+  if( use_speccache && !refresh_speccache ) {
+    speccache.load();
+  }
+  source->read_specfiles( spec_paths,
+			  flags,
+			  jobs > 0 ? jobs : 1,
+			  use_speccache ? &speccache : NULL,
+			  valid_specfiles,
+			  failed_specfiles,
+			  pprinter );
+  if( use_speccache ) {
+    if( verbose ) {
+      cout << "# Spec cache " << speccache.get_cachepath() << ": " <<
+	speccache.get_hits() << " hit(s), " <<
+	speccache.get_misses() << " miss(es)" << endl;
     }
-    // Quick hack while testing, only do the first one
-    //break;
+    speccache.save();
   }
 
   size_t num_specs = valid_specfiles.size();
@@ -166,7 +633,9 @@ int main(int argc, char**argv)
     cout << "# There were " << num_failed_specs <<
       " .spec file(s) that could not be parsed:" << endl;
     for( const string & failed_fn : failed_specfiles ) {
-      cout<< "#     " << failed_fn << endl;
+      auto name_finder = spec_path_names.find( failed_fn );
+      cout<< "#     " << (name_finder != spec_path_names.end() ?
+			  name_finder->second : failed_fn) << endl;
     }
   }
 
@@ -179,22 +648,33 @@ int main(int argc, char**argv)
 
   cout << "# Checking for installed packages and dependencies..." << endl;
 
+  sgug_rpm::installed_db_snapshot installed_db;
+  sgug_rpm::installed_db_cache dbcache( dbcachefile != NULL ?
+					string(dbcachefile) :
+					sgug_rpm::default_installed_db_cache_path(),
+					source->get_installed_fingerprint() );
+  sgug_rpm::load_installed_db( *source,
+			       verbose,
+			       use_dbcache ? &dbcache : NULL,
+			       installed_db,
+			       pprinter );
+
+  if( dumpfixturefile != NULL ) {
+    sgug_rpm::buffered_output_file fixturefile_out( dumpfixturefile );
+    sgug_rpm::write_package_fixture( fixturefile_out, installed_db,
+				     valid_specfiles );
+    if( !fixturefile_out.commit() ) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
   for( const sgug_rpm::specfile & specfile: valid_specfiles ) {
     //    cout << "# Walking spec " << specfile.get_name() << endl;
-    size_t num_valid_rpms = 0;
-    for( const string & pkg : specfile.get_packages() ) {
-      sgug_rpm::installedrpm foundrpm;
-      bool valid_rpm = sgug_rpm::read_installedrpm( verbose, pkg, foundrpm );
-      if( valid_rpm ) {
-	rpms_to_resolve.emplace_back(foundrpm);
-      }
-      else {
-	uninstalled_rpms.push_back(pkg);
-      }
-    }
-    pprinter.accept_progress();
+    sgug_rpm::read_installedrpms( installed_db,
+				  specfile.get_packages(),
+				  rpms_to_resolve,
+				  uninstalled_rpms );
   }
-  pprinter.reset();
 
   size_t num_installed_rpms = rpms_to_resolve.size();
   cout << "# Found " << num_installed_rpms <<
@@ -208,51 +688,94 @@ int main(int argc, char**argv)
     }
   }
 
+  if( profilesfile != NULL ) {
+    vector<sgug_rpm::root_profile> profiles;
+    cout << "# Computing minimal sets of profiles..." << endl;
+    if( !sgug_rpm::read_root_profiles( profilesfile,
+				       sgug_rpm::default_special_packages(),
+				       profiles ) ||
+	!write_profile_outputs( profiles, rpms_to_resolve, installed_db,
+				jobs > 0 ? jobs : 1, pprinter ) ) {
+      exit(EXIT_FAILURE);
+    }
+    sgug_rpm::report_run_stats();
+    return 0;
+  }
+
   cout << "# Computing minimal set..." << endl;
 
   unordered_set<string> special_packages;
-  special_packages.emplace("rpm");
-  special_packages.emplace("sudo");
-  special_packages.emplace("vim-minimal");
-  special_packages.emplace("tar");
-  special_packages.emplace("bzip2");
-  special_packages.emplace("gzip");
-  special_packages.emplace("xz");
-  special_packages.emplace("unzip");
-  special_packages.emplace("openssh-clients");
-  special_packages.emplace("libiconv");
-  special_packages.emplace("info");
-  special_packages.emplace("desktop-file-utils");
-
-  special_packages.emplace("sgugshell");
-
-  special_packages.emplace("dnf-data");
-  special_packages.emplace("microdnf");
-  special_packages.emplace("tdnf");
-
-  special_packages.emplace("sgugrse-release");
-  special_packages.emplace("sgugrse-repos-ostree");
-  special_packages.emplace("sgugrse-repos");
-  special_packages.emplace("sgugrse-release-common");
-  special_packages.emplace("sgugrse-gpg-keys");
-  /*special_packages.emplace("git-all");*/
-  /*special_packages.emplace("sgug-getopt");*/
+  for( const string & special_package : sgug_rpm::default_special_packages() ) {
+    special_packages.emplace( special_package );
+  }
 
   vector<string> missing_deps;
+  vector<vector<string> > cycle_groups;
 
-  vector<sgug_rpm::resolvedrpm> resolved_rpms =
-    sgug_rpm::flatten_sort_packages( rpms_to_resolve, 
-				     [&](const string & pkg_name) -> bool {
-				       if(special_packages.find(pkg_name) !=
-					  special_packages.end()) {
-					 return true;
-				       }
-				       else {
-					 return false;
-				       }
-				     },
-				     missing_deps,
-				     pprinter );
+  auto special_strategy = [&](const string & pkg_name) -> bool {
+    if(special_packages.find(pkg_name) !=
+       special_packages.end()) {
+      return true;
+    }
+    else {
+      return false;
+    }
+  };
+
+  // Kept from the sort for the queries that follow it
+  optional<sgug_rpm::resolved_package_graph> resolved_graph;
+  if( footprint || why_package != NULL ) {
+    resolved_graph.emplace();
+  }
+
+  vector<sgug_rpm::resolvedrpm> resolved_rpms;
+  if( closure_only ) {
+    resolved_rpms =
+      sgug_rpm::closure_sort_packages( rpms_to_resolve,
+				       installed_db,
+				       special_strategy,
+				       missing_deps,
+				       cycle_groups,
+				       jobs > 0 ? jobs : 1,
+				       pprinter,
+				       resolved_graph ? &*resolved_graph : NULL );
+    // Everything else is only needed to be removed - one rpm
+    // transaction sorts out the order itself, so name order will do
+    unordered_set<string> kept_names;
+    for( sgug_rpm::resolvedrpm & rrpm : resolved_rpms ) {
+      kept_names.insert( rrpm.get_package().get_name() );
+    }
+    vector<sgug_rpm::resolvedrpm> removed_rpms;
+    for( const sgug_rpm::installedrpm & package : rpms_to_resolve ) {
+      if( kept_names.find( package.get_name() ) == kept_names.end() ) {
+	removed_rpms.emplace_back( package, 0 );
+      }
+    }
+    std::sort( removed_rpms.begin(), removed_rpms.end(),
+	       []( const sgug_rpm::resolvedrpm & a,
+		   const sgug_rpm::resolvedrpm & b ) -> bool {
+		 return a.get_package().get_name() > b.get_package().get_name();
+	       });
+    // Removes are written walking backwards, so they go in front
+    resolved_rpms.insert( resolved_rpms.begin(), removed_rpms.begin(),
+			  removed_rpms.end() );
+  }
+  else {
+    resolved_rpms =
+      sgug_rpm::flatten_sort_packages( rpms_to_resolve,
+				       installed_db,
+				       special_strategy,
+				       missing_deps,
+				       cycle_groups,
+				       jobs > 0 ? jobs : 1,
+				       pprinter,
+				       resolved_graph ? &*resolved_graph : NULL );
+  }
+
+  if( cycle_groups.size() > 0 ) {
+    cout << "# Found " << cycle_groups.size() <<
+      " dependency cycle(s), see cyclegroups.txt" << endl;
+  }
 
   if( verbose ) {
     uint32_t count = 0;
@@ -278,59 +801,37 @@ int main(int argc, char**argv)
   cout << "Writing output files..." <<
     endl;
 
-  ofstream missingdepsfile;
-  missingdepsfile.open("missingdeps.txt");
-  for( auto & md : missing_deps ) {
-    missingdepsfile << md << endl;
+  if( !write_minimal_set_outputs( path(), resolved_rpms, missing_deps,
+				  cycle_groups ) ) {
+    exit(EXIT_FAILURE);
   }
 
-  ofstream leaveinstalledfile;
-  leaveinstalledfile.open("leaveinstalled.txt");
-
-  ofstream removeexistingfile;
-  removeexistingfile.open("removeexisting.sh");
-  removeexistingfile << "#!/usr/sgug/bin/bash" << endl;
-  removeexistingfile << "# This script should be run under sudo!" << endl;
-  removeexistingfile << "# (and may not work properly due to perl circular " \
-    "dependencies)" << endl;
-
-  // Leave installed we have in the order from least-deps to most-deps
-  for( sgug_rpm::resolvedrpm & rrpm : resolved_rpms ) {
-    if( rrpm.get_special() ) {
-      leaveinstalledfile << rrpm.get_package().get_name() << " " <<
-	rrpm.get_package().get_rpmfile() << endl;
+  if( resolved_graph ) {
+    const sgug_rpm::dep_graph & graph = resolved_graph->graph;
+    vector<uint32_t> root_nodes;
+    for( uint32_t node = 0 ; node < resolved_graph->packages.size() ; ++node ) {
+      uint32_t idx = resolved_graph->packages[node];
+      if( special_strategy( rpms_to_resolve[idx].get_name() ) ) {
+	root_nodes.push_back( node );
+      }
     }
-  }
-
-  // While for remove existing we reverse that to easier remove
-  // First we print a bunch of comments with the package names on a line
-  bool have_rpms_to_remove=false;
-  std::reverse(resolved_rpms.begin(), resolved_rpms.end());
-  for( sgug_rpm::resolvedrpm & rrpm : resolved_rpms ) {
-    if( !rrpm.get_special() ) {
-      have_rpms_to_remove=true;
-      removeexistingfile << "# Should remove " <<
-	rrpm.get_package().get_name() << " " <<
-	rrpm.get_package().get_rpmfile() << endl;
+    if( why_package != NULL ) {
+      print_require_chains( why_package, rpms_to_resolve, *resolved_graph,
+			    root_nodes, why_chains > 0 ? why_chains : 1 );
     }
-  }
-  // Now we'll print a big fat long line with all the removes together
-  // (It's quicker/more correct to get rpm to do it all at once.)
-  if( have_rpms_to_remove ) {
-    removeexistingfile << "rpm -evh";
-  }
-  for( sgug_rpm::resolvedrpm & rrpm : resolved_rpms ) {
-    if( !rrpm.get_special() ) {
-      removeexistingfile << " " << rrpm.get_package().get_name();
+    if( footprint ) {
+      cout << "# Computing footprints, see footprint.txt" << endl;
+      sgug_rpm::dep_graph_sccs sccs( graph );
+      if( !write_footprint( path(), rpms_to_resolve,
+			    resolved_graph->packages, sccs,
+			    sgug_rpm::build_component_graph( graph, sccs ),
+			    root_nodes ) ) {
+	exit(EXIT_FAILURE);
+      }
     }
   }
-  if( have_rpms_to_remove ) {
-    removeexistingfile << endl;
-  }
 
-  removeexistingfile.close();
-  leaveinstalledfile.close();
-  missingdepsfile.close();
+  sgug_rpm::report_run_stats();
 
   return 0;
 }
@@ -0,0 +1,689 @@
+#include "helpers.hpp"
+#include "specfile.hpp"
+#include "speccache.hpp"
+#include "installedrpm.hpp"
+#include "installeddb.hpp"
+#include "installeddbcache.hpp"
+#include "buildschedule.hpp"
+#include "depclosure.hpp"
+#include "localsocket.hpp"
+#include "packagesource.hpp"
+#include "srpmindex.hpp"
+#include "sgug_dep_engine.hpp"
+#include "runstats.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+#include <rpm/rpmcli.h>
+#include <rpm/rpmlog.h>
+
+// C++ structures/algorithms
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::optional;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::unique_ptr;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+using std::filesystem::path;
+
+namespace fs = std::filesystem;
+
+static char * gitrootdir = NULL;
+static char * inputdir = NULL;
+static char * socketfile = NULL;
+static char * send_request = NULL;
+static int jobs = 1;
+static char * speccachefile = NULL;
+static int no_speccache = 0;
+static int refresh_speccache = 0;
+static char * dbcachefile = NULL;
+static int no_dbcache = 0;
+static char * fixturefile = NULL;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// Per client limits, see the accept loop
+static const unsigned int client_timeout_seconds = 30;
+static const size_t max_request_length = 64 * 1024;
+
+static struct poptOption optionsTable[] = {
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
+    "Common options for all rpm modes and executables",
+    NULL },
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, sgug_rpm::runStatsPoptTable, 0,
+    "Instrumentation options",
+    NULL },
+  {
+    "gitroot",
+    'g',
+    POPT_ARG_STRING,
+    &gitrootdir,
+    0,
+    "RSE git repository directory containing releasepackages.lst",
+    NULL
+  },
+  {
+    "inputdir",
+    'i',
+    POPT_ARG_STRING,
+    &inputdir,
+    0,
+    "Input dir with SRPMs to index (optional)",
+    NULL
+  },
+  {
+    "socket",
+    's',
+    POPT_ARG_STRING,
+    &socketfile,
+    0,
+    "Unix domain socket to listen on (default ~/.cache/sgug-rpm-tools/server.sock)",
+    "FILE"
+  },
+  {
+    "send",
+    '\0',
+    POPT_ARG_STRING,
+    &send_request,
+    0,
+    "Send one request to a running server, print the answer and exit",
+    "REQUEST"
+  },
+  {
+    "jobs",
+    'j',
+    POPT_ARG_INT,
+    &jobs,
+    0,
+    "Number of parallel workers used to parse specs and order packages",
+    "N"
+  },
+  {
+    "speccache",
+    '\0',
+    POPT_ARG_STRING,
+    &speccachefile,
+    0,
+    "Spec parse cache file (default ~/.cache/sgug-rpm-tools/speccache.bin)",
+    "FILE"
+  },
+  {
+    "nospeccache",
+    '\0',
+    POPT_ARG_NONE,
+    &no_speccache,
+    0,
+    "Always parse every spec file, ignoring the spec parse cache",
+    NULL
+  },
+  {
+    "refreshspeccache",
+    '\0',
+    POPT_ARG_NONE,
+    &refresh_speccache,
+    0,
+    "Parse every spec file again and rewrite the spec parse cache",
+    NULL
+  },
+  {
+    "dbcache",
+    '\0',
+    POPT_ARG_STRING,
+    &dbcachefile,
+    0,
+    "Installed package cache file (default ~/.cache/sgug-rpm-tools/installeddb.bin)",
+    "FILE"
+  },
+  {
+    "nodbcache",
+    '\0',
+    POPT_ARG_NONE,
+    &no_dbcache,
+    0,
+    "Always read installed packages from the rpmdb, ignoring the installed package cache",
+    NULL
+  },
+  {
+    "fixture",
+    '\0',
+    POPT_ARG_STRING,
+    &fixturefile,
+    0,
+    "Read installed packages and specs from a fixture file instead of the rpmdb and librpm",
+    "FILE"
+  },
+  POPT_AUTOALIAS
+  POPT_AUTOHELP
+  POPT_TABLEEND
+};
+
+static void handle_stop_signal( int ) {
+  stop_requested = 1;
+}
+
+// Answers are "OK <n>" followed by n lines, or a single "ERROR <why>"
+static string ok_response( const vector<string> & lines ) {
+  stringstream response_buf;
+  response_buf << "OK " << lines.size() << "\n";
+  for( const string & line : lines ) {
+    response_buf << line << "\n";
+  }
+  return response_buf.str();
+}
+
+static string error_response( const string & why ) {
+  return "ERROR " + why + "\n";
+}
+
+// Everything the one shot tools load at start up, kept between requests
+class server_state {
+  sgug_rpm::package_source & _source;
+  bool _verbose;
+  unsigned int _jobs;
+  path _gitrootdir;
+  optional<string> _srpmdir;
+  sgug_rpm::specfile_cache * _speccache;
+  optional<string> _dbcachepath;
+  sgug_rpm::progress_printer & _pprinter;
+
+  vector<sgug_rpm::specfile> _specs;
+  unordered_map<string,size_t> _spec_index;
+  unordered_map<string,string> _srpm_index;
+
+  string _rpmdb_fingerprint;
+  sgug_rpm::installed_db_snapshot _installed_db;
+  unordered_map<string,uint32_t> _name_to_node;
+  unique_ptr<sgug_rpm::reverse_closure_index> _closures;
+
+public:
+  server_state( sgug_rpm::package_source & source,
+		bool verbose,
+		unsigned int jobs,
+		path gitrootdir,
+		optional<string> srpmdir,
+		sgug_rpm::specfile_cache * speccache,
+		optional<string> dbcachepath,
+		sgug_rpm::progress_printer & pprinter )
+    : _source(source),
+      _verbose(verbose),
+      _jobs(jobs),
+      _gitrootdir(gitrootdir),
+      _srpmdir(srpmdir),
+      _speccache(speccache),
+      _dbcachepath(dbcachepath),
+      _pprinter(pprinter) {}
+
+  bool load_specs() {
+    std::ifstream input( _gitrootdir / "releasepackages.lst" );
+    if( !input ) {
+      cerr << "Unable to read " << _gitrootdir / "releasepackages.lst" << endl;
+      return false;
+    }
+    vector<string> spec_paths;
+    for( string line; std::getline(input, line); ) {
+      // Skip comments + empty lines
+      if( line.length() == 0 || line[0] == '#' ) {
+	continue;
+      }
+      optional<string> spec_path_opt =
+	_source.find_specfile( _gitrootdir, line );
+      if( !spec_path_opt ) {
+	cerr << "Missing spec for " << line << endl;
+	continue;
+      }
+      spec_paths.push_back( *spec_path_opt );
+    }
+
+    vector<sgug_rpm::specfile> specs;
+    vector<string> failed_specs;
+    _source.read_specfiles( spec_paths, RPMSPEC_FORCE, _jobs, _speccache,
+			    specs, failed_specs, _pprinter );
+    for( const string & failed_spec : failed_specs ) {
+      cerr << "Unable to parse " << failed_spec << endl;
+    }
+    if( _speccache != NULL ) {
+      _speccache->save();
+    }
+
+    _specs.swap( specs );
+    _spec_index.clear();
+    for( size_t idx = 0 ; idx < _specs.size() ; ++idx ) {
+      _spec_index[_specs[idx].get_name()] = idx;
+    }
+    cout << "# Loaded " << _specs.size() << " spec(s)" << endl;
+    return true;
+  }
+
+  void load_srpms() {
+    _srpm_index.clear();
+    if( _srpmdir ) {
+      sgug_rpm::build_srpm_index( _verbose, *_srpmdir, _jobs,
+				  _srpm_index, _pprinter );
+      cout << "# Indexed " << _srpm_index.size() << " SRPM(s)" << endl;
+    }
+  }
+
+  // Reloads the installed set when (and only when) the rpmdb changed
+  void refresh_installed() {
+    string rpmdb_fingerprint = _source.get_installed_fingerprint();
+    if( _closures && rpmdb_fingerprint == _rpmdb_fingerprint ) {
+      return;
+    }
+    unique_ptr<sgug_rpm::installed_db_cache> dbcache;
+    if( _dbcachepath ) {
+      dbcache.reset( new sgug_rpm::installed_db_cache( *_dbcachepath,
+							rpmdb_fingerprint ) );
+    }
+    sgug_rpm::installed_db_snapshot installed_db;
+    sgug_rpm::load_installed_db( _source, _verbose, dbcache.get(),
+				 installed_db, _pprinter );
+
+    sgug_rpm::dep_graph graph;
+    vector<string> missing_deps;
+    if( !dbcache || !dbcache->load_graph( graph, missing_deps ) ) {
+      graph = sgug_rpm::build_package_graph( installed_db.get_packages(),
+					     installed_db, missing_deps,
+					     _pprinter );
+      _pprinter.reset();
+      if( dbcache ) {
+	dbcache->save( installed_db, &graph, &missing_deps );
+      }
+    }
+
+    _installed_db = std::move(installed_db);
+    _name_to_node.clear();
+    const vector<sgug_rpm::installedrpm> & packages = _installed_db.get_packages();
+    for( uint32_t node = 0 ; node < packages.size() ; ++node ) {
+      _name_to_node[packages[node].get_name()] = node;
+    }
+    _closures.reset( new sgug_rpm::reverse_closure_index( graph ) );
+    _rpmdb_fingerprint = rpmdb_fingerprint;
+    cout << "# Loaded " << packages.size() << " installed package(s)" << endl;
+  }
+
+  string whatprovides( const vector<string> & args ) {
+    if( args.size() != 1 ) {
+      return error_response( "usage: whatprovides REQUIRE" );
+    }
+    sgug_rpm::installedrpm package;
+    if( _installed_db.find_package( args[0], package ) ) {
+      return ok_response( { package.get_name() } );
+    }
+    optional<pair<string,string> > provider_opt =
+      _installed_db.find_package_providing_file( args[0] );
+    if( !provider_opt ) {
+      provider_opt = _installed_db.find_package_providing_tag( args[0] );
+    }
+    if( !provider_opt ) {
+      return error_response( "nothing installed provides " + args[0] );
+    }
+    return ok_response( { (*provider_opt).first } );
+  }
+
+  string builddeps( const vector<string> & args ) {
+    if( args.size() != 1 ) {
+      return error_response( "usage: builddeps SPEC" );
+    }
+    auto finder = _spec_index.find( args[0] );
+    if( finder == _spec_index.end() ) {
+      return error_response( "no spec named " + args[0] );
+    }
+    vector<string> build_deps;
+    for( auto & entry : _specs[finder->second].get_build_deps() ) {
+      build_deps.insert( build_deps.end(), entry.second.begin(),
+			 entry.second.end() );
+    }
+    std::sort( build_deps.begin(), build_deps.end() );
+    build_deps.erase( std::unique( build_deps.begin(), build_deps.end() ),
+		      build_deps.end() );
+    return ok_response( build_deps );
+  }
+
+  // One line per build group: level then the spec(s) in it
+  string buildorder( const vector<string> & args ) {
+    vector<string> unresolved_build_deps;
+    vector<sgug_rpm::build_group> build_schedule =
+      sgug_rpm::compute_build_schedule( _specs, _installed_db,
+					unresolved_build_deps );
+    vector<string> lines;
+    for( const sgug_rpm::build_group & group : build_schedule ) {
+      stringstream line_buf;
+      line_buf << group.get_level();
+      for( const string & spec : group.get_specs() ) {
+	line_buf << " " << spec;
+      }
+      lines.push_back( line_buf.str() );
+    }
+    return ok_response( lines );
+  }
+
+  string srpm( const vector<string> & args ) {
+    if( args.size() != 1 ) {
+      return error_response( "usage: srpm SPEC" );
+    }
+    auto finder = _srpm_index.find( args[0] );
+    if( finder == _srpm_index.end() ) {
+      return error_response( "no SRPM for " + args[0] );
+    }
+    return ok_response( { finder->second } );
+  }
+
+  // Same as leaveinstalled.txt: the packages kept, least requires first
+  string minimalset( const vector<string> & args ) {
+    unordered_set<string> special_packages;
+    if( args.size() > 0 ) {
+      special_packages.insert( args.begin(), args.end() );
+    }
+    else {
+      for( const string & special_package : sgug_rpm::default_special_packages() ) {
+	special_packages.insert( special_package );
+      }
+    }
+
+    vector<sgug_rpm::installedrpm> rpms_to_resolve;
+    vector<string> uninstalled_rpms;
+    for( const sgug_rpm::specfile & specfile : _specs ) {
+      sgug_rpm::read_installedrpms( _installed_db, specfile.get_packages(),
+				    rpms_to_resolve, uninstalled_rpms );
+    }
+    vector<string> missing_deps;
+    vector<vector<string> > cycle_groups;
+    // Only the minimal set is answered, so only it needs resolving
+    vector<sgug_rpm::resolvedrpm> resolved_rpms =
+      sgug_rpm::closure_sort_packages( rpms_to_resolve,
+				       _installed_db,
+				       [&](const string & pkg_name) -> bool {
+					 return special_packages.find(pkg_name) !=
+					   special_packages.end();
+				       },
+				       missing_deps,
+				       cycle_groups,
+				       _jobs,
+				       _pprinter );
+    vector<string> lines;
+    for( sgug_rpm::resolvedrpm & rrpm : resolved_rpms ) {
+      if( rrpm.get_special() ) {
+	lines.push_back( rrpm.get_package().get_name() + " " +
+			 rrpm.get_package().get_rpmfile() );
+      }
+    }
+    return ok_response( lines );
+  }
+
+  string impact( const vector<string> & args ) {
+    if( args.size() == 0 ) {
+      return error_response( "usage: impact PACKAGE..." );
+    }
+    vector<uint32_t> nodes;
+    unordered_set<uint32_t> queried;
+    for( const string & name : args ) {
+      auto finder = _name_to_node.find( name );
+      if( finder == _name_to_node.end() ) {
+	return error_response( "package " + name + " is not installed" );
+      }
+      nodes.push_back( finder->second );
+      queried.insert( finder->second );
+    }
+    vector<uint32_t> closure;
+    _closures->query( nodes, closure );
+    vector<string> affected;
+    for( uint32_t node : closure ) {
+      if( queried.find(node) == queried.end() ) {
+	affected.push_back( _installed_db.get_packages()[node].get_name() );
+      }
+    }
+    std::sort( affected.begin(), affected.end() );
+    affected.erase( std::unique( affected.begin(), affected.end() ),
+		    affected.end() );
+    return ok_response( affected );
+  }
+
+  // Timings and counters since the server started
+  string stats() {
+    stringstream report_buf;
+    sgug_rpm::print_run_stats( report_buf );
+    vector<string> lines;
+    for( string line; std::getline( report_buf, line ); ) {
+      lines.push_back( line );
+    }
+    return ok_response( lines );
+  }
+
+  string handle( const string & request, bool & close_connection ) {
+    stringstream request_buf( request );
+    string command;
+    vector<string> args;
+    request_buf >> command;
+    for( string arg; request_buf >> arg; ) {
+      args.push_back( arg );
+    }
+
+    if( command == "quit" ) {
+      close_connection = true;
+      return ok_response( {} );
+    }
+    if( command == "shutdown" ) {
+      close_connection = true;
+      stop_requested = 1;
+      return ok_response( {} );
+    }
+    if( command == "refresh" ) {
+      // Specs go through the spec cache, so only changed ones re-parse
+      if( !load_specs() ) {
+	return error_response( "unable to reload specs" );
+      }
+      load_srpms();
+      refresh_installed();
+      return ok_response( {} );
+    }
+
+    refresh_installed();
+    if( command == "ping" ) {
+      return ok_response( {} );
+    }
+    else if( command == "stats" ) {
+      return stats();
+    }
+    else if( command == "whatprovides" ) {
+      return whatprovides( args );
+    }
+    else if( command == "builddeps" ) {
+      return builddeps( args );
+    }
+    else if( command == "buildorder" ) {
+      return buildorder( args );
+    }
+    else if( command == "srpm" ) {
+      return srpm( args );
+    }
+    else if( command == "minimalset" ) {
+      return minimalset( args );
+    }
+    else if( command == "impact" ) {
+      return impact( args );
+    }
+    return error_response( "unknown request " + command );
+  }
+};
+
+static int send_one_request( const string & socketpath,
+			     const string & request ) {
+  sgug_rpm::line_connection connection( sgug_rpm::connect_unix_socket( socketpath ) );
+  if( !connection.is_valid() ) {
+    cerr << "No server listening on " << socketpath << endl;
+    return EXIT_FAILURE;
+  }
+  string status;
+  if( !connection.write_all( request + "\n" ) ||
+      !connection.read_line( status ) ) {
+    cerr << "Lost connection to server" << endl;
+    return EXIT_FAILURE;
+  }
+  if( !sgug_rpm::str_starts_with( status, "OK " ) ) {
+    cerr << status << endl;
+    return EXIT_FAILURE;
+  }
+  char * end;
+  errno = 0;
+  unsigned long num_lines = strtoul( status.c_str() + 3, &end, 10 );
+  if( errno != 0 || end == status.c_str() + 3 || *end != '\0' ) {
+    cerr << "Malformed reply from server: " << status << endl;
+    return EXIT_FAILURE;
+  }
+  for( unsigned long i = 0 ; i < num_lines ; ++i ) {
+    string line;
+    if( !connection.read_line( line ) ) {
+      cerr << "Lost connection to server" << endl;
+      return EXIT_FAILURE;
+    }
+    cout << line << endl;
+  }
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char**argv)
+{
+  sgug_rpm::poptcontext_h popt_context( argc, argv, optionsTable );
+  rpmlogSetMask(RPMLOG_ERR);
+
+  if( popt_context.context == NULL ) {
+    exit(EXIT_FAILURE);
+  }
+
+  string socketpath = socketfile != NULL ? string(socketfile) :
+    sgug_rpm::default_cache_path( "server.sock" );
+
+  if( send_request != NULL ) {
+    return send_one_request( socketpath, send_request );
+  }
+
+  if( gitrootdir == NULL ) {
+    cerr << "gitrootdir must be passed" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  bool verbose = popt_context.verbose;
+  unsigned int num_jobs = jobs > 0 ? jobs : 1;
+
+  std::unique_ptr<sgug_rpm::package_source> source =
+    sgug_rpm::open_package_source( popt_context, fixturefile );
+  if( !source ) {
+    exit(EXIT_FAILURE);
+  }
+  // Fixtures never touch the default caches, only ones asked for
+  bool use_speccache = !no_speccache && fixturefile == NULL;
+  bool use_dbcache = !no_dbcache &&
+    (fixturefile == NULL || dbcachefile != NULL);
+
+  // Only a log to write to, no terminal for a spinner
+  sgug_rpm::progress_printer pprinter( false );
+
+  rpmSpecFlags flags = (RPMSPEC_FORCE);
+  sgug_rpm::specfile_cache speccache( speccachefile != NULL ?
+				      string(speccachefile) :
+				      sgug_rpm::default_speccache_path(),
+				      sgug_rpm::compute_spec_macro_fingerprint(flags) );
+  if( use_speccache && !refresh_speccache ) {
+    speccache.load();
+  }
+  optional<string> dbcachepath;
+  if( use_dbcache ) {
+    dbcachepath = dbcachefile != NULL ? string(dbcachefile) :
+      sgug_rpm::default_installed_db_cache_path();
+  }
+  optional<string> srpmdir;
+  if( inputdir != NULL ) {
+    srpmdir = string(inputdir);
+  }
+
+  server_state state( *source, verbose, num_jobs, path(gitrootdir),
+		      srpmdir, use_speccache ? &speccache : NULL,
+		      dbcachepath, pprinter );
+  if( !state.load_specs() ) {
+    exit(EXIT_FAILURE);
+  }
+  state.load_srpms();
+  state.refresh_installed();
+
+  path socket_p = path(socketpath);
+  if( socket_p.has_parent_path() ) {
+    std::error_code ec;
+    fs::create_directories( socket_p.parent_path(), ec );
+  }
+  sgug_rpm::unix_socket_listener listener( socketpath );
+  if( !listener.is_valid() ) {
+    exit(EXIT_FAILURE);
+  }
+
+  // No SA_RESTART, so a stop signal breaks us out of accept()
+  struct sigaction stop_action;
+  memset( &stop_action, 0, sizeof(stop_action) );
+  stop_action.sa_handler = handle_stop_signal;
+  sigaction( SIGINT, &stop_action, NULL );
+  sigaction( SIGTERM, &stop_action, NULL );
+  signal( SIGPIPE, SIG_IGN );
+
+  cout << "# Listening on " << socketpath << endl;
+
+  // One client at a time - librpm isn't thread safe, and answers from
+  // warm state are quick enough that clients barely queue. A client
+  // that goes quiet, never ends its line or stops reading its answers
+  // is dropped so it can't hold up the rest.
+  while( !stop_requested ) {
+    int client_fd = listener.accept_client();
+    if( client_fd < 0 ) {
+      if( errno == EINTR ) {
+	continue;
+      }
+      cerr << "Unable to accept connection: " << strerror(errno) << endl;
+      break;
+    }
+    sgug_rpm::line_connection connection( client_fd );
+    connection.set_stop_flag( &stop_requested );
+    connection.set_receive_timeout( client_timeout_seconds );
+    connection.set_send_timeout( client_timeout_seconds );
+    connection.set_max_line_length( max_request_length );
+    bool close_connection = false;
+    string request;
+    while( !close_connection && !stop_requested &&
+	   connection.read_line( request ) ) {
+      if( request.empty() ) {
+	continue;
+      }
+      if( verbose ) {
+	cout << "# Request: " << request << endl;
+      }
+      if( !connection.write_all( state.handle( request, close_connection ) ) ) {
+	break;
+      }
+    }
+  }
+
+  cout << "# Shutting down" << endl;
+
+  sgug_rpm::report_run_stats();
+
+  return 0;
+}
@@ -1,12 +1,21 @@
 #include "helpers.hpp"
 #include "specfile.hpp"
+#include "speccache.hpp"
 #include "installedrpm.hpp"
+#include "installeddb.hpp"
+#include "packagesource.hpp"
+#include "buildschedule.hpp"
+#include "buildmanifest.hpp"
 #include "standalonerpm.hpp"
+#include "srpmindex.hpp"
 #include "dependencyset.hpp"
+#include "bufferedoutput.hpp"
+#include "runstats.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <memory>
 #include <optional>
 
 #include <rpm/header.h>
@@ -28,7 +37,6 @@ using std::cout;
 using std::cerr;
 using std::cin;
 using std::endl;
-using std::ofstream;
 using std::vector;
 using std::unordered_map;
 using std::unordered_set;
@@ -43,12 +51,24 @@ static char * inputdir = NULL;
 static char * outputdir = NULL;
 static char * gitrootdir = NULL;
 static int partial_allowed = 0;
+static int jobs = 1;
+static char * speccachefile = NULL;
+static int no_speccache = 0;
+static int refresh_speccache = 0;
+static int buildjobs = 1;
+static int incremental = 0;
+static char * manifestfile = NULL;
+static char * fixturefile = NULL;
 
 static struct poptOption optionsTable[] = {
   {
     NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
     "Common options for all rpm modes and executables",
     NULL },
+  {
+    NULL, '\0', POPT_ARG_INCLUDE_TABLE, sgug_rpm::runStatsPoptTable, 0,
+    "Instrumentation options",
+    NULL },
   {
     "inputdir",
     'i',
@@ -85,77 +105,83 @@ static struct poptOption optionsTable[] = {
     "Accept partial SRPM/spec availability (do NOT use this when performing a complete build)",
     NULL
   },
+  {
+    "jobs",
+    'j',
+    POPT_ARG_INT,
+    &jobs,
+    0,
+    "Number of parallel worker processes used to parse spec files",
+    "N"
+  },
+  {
+    "speccache",
+    '\0',
+    POPT_ARG_STRING,
+    &speccachefile,
+    0,
+    "Spec parse cache file (default ~/.cache/sgug-rpm-tools/speccache.bin)",
+    "FILE"
+  },
+  {
+    "nospeccache",
+    '\0',
+    POPT_ARG_NONE,
+    &no_speccache,
+    0,
+    "Always parse every spec file, ignoring the spec parse cache",
+    NULL
+  },
+  {
+    "refreshspeccache",
+    '\0',
+    POPT_ARG_NONE,
+    &refresh_speccache,
+    0,
+    "Parse every spec file again and rewrite the spec parse cache",
+    NULL
+  },
+  {
+    "buildjobs",
+    'b',
+    POPT_ARG_INT,
+    &buildjobs,
+    0,
+    "Maximum number of package builds worldrebuilder.sh runs concurrently",
+    "N"
+  },
+  {
+    "incremental",
+    '\0',
+    POPT_ARG_NONE,
+    &incremental,
+    0,
+    "Only rebuild specs whose inputs (or build dependencies) changed since their last successful build",
+    NULL
+  },
+  {
+    "manifest",
+    '\0',
+    POPT_ARG_STRING,
+    &manifestfile,
+    0,
+    "Successful build manifest (default OUTPUTDIR/buildmanifest.txt)",
+    "FILE"
+  },
+  {
+    "fixture",
+    '\0',
+    POPT_ARG_STRING,
+    &fixturefile,
+    0,
+    "Read installed packages and specs from a fixture file instead of the rpmdb and librpm",
+    "FILE"
+  },
   POPT_AUTOALIAS
   POPT_AUTOHELP
   POPT_TABLEEND
 };
 
-optional<string> calculate_expected_specfile_path( string sgug_rse_git_root,
-					 string package_name ) {
-  path srgr_path = std::filesystem::path(sgug_rse_git_root);
-  path package_spec_path = srgr_path / "packages" / package_name / "SPECS" / (package_name + ".spec");
-  if( fs::exists(package_spec_path) ) {
-    return {fs::canonical(package_spec_path)};
-  }
-  else {
-    return {};
-  }
-}
-
-optional<string> find_srpm_for_package( bool verbose,
-					string sgug_rse_srpm_archive_root,
-					string srpm_name )
-{
-  path candidate_path = std::filesystem::path(sgug_rse_srpm_archive_root);
-  if( verbose ) {
-    cout << "# Looking for " << srpm_name << " under " << candidate_path << endl;
-  }
-  if( fs::exists(candidate_path) && fs::is_directory(candidate_path)) {
-    vector<path> candidates;
-    for( const auto & entry : fs::directory_iterator(candidate_path)) {
-      path entry_path = entry.path();
-      string entry_filename = entry_path.filename();
-      //      if( verbose ) {
-      //	cout << "# Looking for " << srpm_name << " at " << entry_filename <<
-      //	  endl;
-      //      }
-      if((!fs::is_directory(entry_path)) &&
-	 sgug_rpm::str_starts_with(entry_filename,srpm_name) &&
-	 sgug_rpm::str_ends_with(entry_filename, ".src.rpm") ) {
-	candidates.push_back(entry_path);
-	if( verbose ) {
-	  cout << "# Found candidate: " << entry_filename << endl;
-	}
-      }
-
-    }
-    if(candidates.size() > 0) {
-      for( const path & cp : candidates ) {
-	sgug_rpm::standalonerpm sarpm;
-	string canonical_filename = fs::canonical(cp);
-	if( sgug_rpm::read_standalonerpm( verbose, canonical_filename,
-					  sarpm ) ) {
-	  if( sarpm.get_name() == srpm_name ) {
-	    return {cp.filename()};
-	  }
-	  else if(verbose) {
-	    cout << "# Examined " << canonical_filename <<
-	      " but failed match of package name" << endl;
-	  }
-	}
-	else if(verbose) {
-	  cerr << "# Couldn't open " << canonical_filename << endl;
-	}
-      }
-    }
-      
-    return {};
-  }
-  else {
-    return {};
-  }
-}
-
 int main(int argc, char**argv)
 {
   vector<sgug_rpm::specfile> valid_specfiles;
@@ -185,12 +211,21 @@ int main(int argc, char**argv)
       "used when performing a full world build" << endl;
   }
 
+  std::unique_ptr<sgug_rpm::package_source> source =
+    sgug_rpm::open_package_source( popt_context, fixturefile );
+  if( !source ) {
+    exit(EXIT_FAILURE);
+  }
+  bool use_speccache = !no_speccache && fixturefile == NULL;
+
   sgug_rpm::progress_printer pprinter;
 
   path inputsrpm_p = inputdir_p;
   path buildprogress_p = outputdir_p / "PROGRESS";
   path outputsrpm_p = outputdir_p / "SRPMS";
   path outputrpm_p = outputdir_p / "RPMS";
+  path manifest_p = manifestfile != NULL ? path(manifestfile) :
+    outputdir_p / "buildmanifest.txt";
 
   cout << "# Reading spec files..." << endl;
 
@@ -211,10 +246,12 @@ int main(int argc, char**argv)
   }
   input.close();
 
+  vector<string> spec_paths;
+  // Failures come back as spec paths, but are reported by package name
+  unordered_map<string,string> spec_path_names;
   for( string & package_name : names_in ) {
     optional<string> expected_specfile_path_opt =
-      calculate_expected_specfile_path( gitrootdir_p,
-					package_name );
+      source->find_specfile( gitrootdir_p, package_name );
     if( !expected_specfile_path_opt ) {
       cerr << "Missing spec for " << package_name << endl;
       cerr << "Looked under " << gitrootdir_p << "/packages/" <<
@@ -222,22 +259,35 @@ int main(int argc, char**argv)
       exit(EXIT_FAILURE);
     }
     string expected_specfile_path = *expected_specfile_path_opt;
-    sgug_rpm::specfile specfile;
     if( verbose ) {
       cout << "# Checking for spec at " << expected_specfile_path << endl;
     }
-    rpmSpecFlags flags = (RPMSPEC_FORCE);
-    if( sgug_rpm::read_specfile( expected_specfile_path,
-				 flags,
-				 specfile,
-				 pprinter ) ) {
-      valid_specfiles.emplace_back( specfile );
-    }
-    else {
-      failed_specfiles.push_back( package_name );
+    spec_paths.push_back( expected_specfile_path );
+    spec_path_names.emplace( expected_specfile_path, package_name );
+  }
+
+  rpmSpecFlags flags = (RPMSPEC_FORCE);
+  sgug_rpm::specfile_cache speccache( speccachefile != NULL ?
+				      string(speccachefile) :
+				      sgug_rpm::default_speccache_path(),
+				      sgug_rpm::compute_spec_macro_fingerprint(flags) );
+  if( use_speccache && !refresh_speccache ) {
+    speccache.load();
+  }
+  source->read_specfiles( spec_paths,
+			  flags,
+			  jobs > 0 ? jobs : 1,
+			  use_speccache ? &speccache : NULL,
+			  valid_specfiles,
+			  failed_specfiles,
+			  pprinter );
+  if( use_speccache ) {
+    if( verbose ) {
+      cout << "# Spec cache " << speccache.get_cachepath() << ": " <<
+	speccache.get_hits() << " hit(s), " <<
+	speccache.get_misses() << " miss(es)" << endl;
     }
-    // Quick hack while testing, only do the first one
-    //break;
+    speccache.save();
   }
 
   size_t num_specs = valid_specfiles.size();
@@ -258,7 +308,9 @@ int main(int argc, char**argv)
     cout << "# There were " << num_failed_specs <<
       " .spec file(s) that could not be parsed:" << endl;
     for( const string & failed_fn : failed_specfiles ) {
-      cout<< "#     " << failed_fn << endl;
+      auto name_finder = spec_path_names.find( failed_fn );
+      cout<< "#     " << (name_finder != spec_path_names.end() ?
+			  name_finder->second : failed_fn) << endl;
     }
     exit(EXIT_FAILURE);
   }
@@ -266,20 +318,34 @@ int main(int argc, char**argv)
   vector<sgug_rpm::specfile> specs_to_rebuild = valid_specfiles;
 
   cout << "# Checking availability of SRPMs for packages..." << endl;
+  unordered_map<string,string> available_srpms;
+  if( verbose ) {
+    cout << "# Indexing SRPMs under " << inputsrpm_p << endl;
+  }
+  sgug_rpm::build_srpm_index( verbose, inputsrpm_p,
+			      jobs > 0 ? jobs : 1,
+			      available_srpms, pprinter );
+
   unordered_map<string,string> package_to_srpm_map;
 
   vector<string> missing_srpms;
 
+  static sgug_rpm::stat_counter srpm_lookups( "srpm lookups" );
+  static sgug_rpm::stat_counter srpm_misses( "srpm lookup misses" );
   for( const sgug_rpm::specfile & specfile : valid_specfiles ) {
     const string & srpm_name = specfile.get_name();
-    cout << "# Looking for srpm " << srpm_name << endl;
-    optional<string> found_srpm_opt =
-      find_srpm_for_package( verbose, inputsrpm_p, srpm_name );
-    if( !found_srpm_opt ) {
+    auto srpm_finder = available_srpms.find( srpm_name );
+    srpm_lookups.add();
+    if( srpm_finder == available_srpms.end() ) {
+      srpm_misses.add();
       missing_srpms.push_back( srpm_name );
     }
     else {
-      package_to_srpm_map[srpm_name] = *found_srpm_opt;
+      if( verbose ) {
+	cout << "# Found srpm " << srpm_finder->second << " for " <<
+	  srpm_name << endl;
+      }
+      package_to_srpm_map[srpm_name] = srpm_finder->second;
     }
   }
 
@@ -292,114 +358,250 @@ int main(int argc, char**argv)
     exit(EXIT_FAILURE);
   }
 
+  cout << "# Computing build order..." << endl;
+
+  sgug_rpm::installed_db_snapshot installed_db;
+  source->load_installed( false, installed_db, pprinter );
+
+  vector<string> unresolved_build_deps;
+  sgug_rpm::dep_graph spec_graph =
+    sgug_rpm::build_spec_graph( specs_to_rebuild,
+				installed_db,
+				unresolved_build_deps );
+  vector<sgug_rpm::build_group> build_schedule =
+    sgug_rpm::compute_build_schedule( specs_to_rebuild, spec_graph );
+  if( verbose ) {
+    for( const string & unresolved : unresolved_build_deps ) {
+      cout << "# " << unresolved << endl;
+    }
+  }
+
+  cout << "# Fingerprinting build inputs..." << endl;
+
+  vector<string> input_fingerprints;
+  for( const sgug_rpm::specfile & specfile : specs_to_rebuild ) {
+    const string & name = specfile.get_name();
+    auto srpm_finder = package_to_srpm_map.find( name );
+    string srpm_path;
+    if( srpm_finder != package_to_srpm_map.end() ) {
+      srpm_path = inputsrpm_p / srpm_finder->second;
+    }
+    optional<string> fingerprint_opt =
+      sgug_rpm::compute_spec_input_fingerprint( specfile.get_filepath(),
+						gitrootdir_p / "packages" / name,
+						srpm_path );
+    if( !fingerprint_opt ) {
+      cerr << "Unable to fingerprint inputs of " << name <<
+	", it will always be rebuilt" << endl;
+    }
+    input_fingerprints.push_back( fingerprint_opt ? *fingerprint_opt : "" );
+  }
+  vector<string> build_fingerprints;
+  sgug_rpm::compute_build_fingerprints( spec_graph, input_fingerprints,
+					build_fingerprints );
+
+  unordered_map<string,string> package_to_fingerprint_map;
+  for( size_t idx = 0 ; idx < specs_to_rebuild.size() ; ++idx ) {
+    package_to_fingerprint_map[specs_to_rebuild[idx].get_name()] =
+      build_fingerprints[idx];
+  }
+
+  // Build fingerprints include those of all build dependencies, so a
+  // mismatch picks up changed specs plus everything that build requires
+  // them, and a half-finished incremental run resumes correctly.
+  unordered_set<string> unchanged_specs;
+  if( incremental ) {
+    sgug_rpm::build_manifest manifest;
+    if( !manifest.load( manifest_p ) ) {
+      cerr << "Unable to read build manifest " << manifest_p << endl;
+      exit(EXIT_FAILURE);
+    }
+    for( auto & entry : package_to_fingerprint_map ) {
+      optional<string> built_fingerprint_opt =
+	manifest.find_fingerprint( entry.first );
+      if( !entry.second.empty() && built_fingerprint_opt &&
+	  *built_fingerprint_opt == entry.second ) {
+	unchanged_specs.insert( entry.first );
+      }
+    }
+    cout << "# Incremental: " <<
+      (specs_to_rebuild.size() - unchanged_specs.size()) << " of " <<
+      specs_to_rebuild.size() << " spec(s) need rebuilding" << endl;
+  }
+
+  uint32_t num_levels = 0;
+  if( build_schedule.size() > 0 ) {
+    num_levels = build_schedule.back().get_level() + 1;
+  }
+  cout << "# Build schedule has " << num_levels << " level(s)" << endl;
+
   cout << "# Writing worldrebuilder.sh..." << endl;
 
-  // Get everything in nice a->z order
-  std::sort(specs_to_rebuild.begin(), specs_to_rebuild.end(),
-	    [](const sgug_rpm::specfile & a, const sgug_rpm::specfile & b ) -> bool {
-	      return a.get_name() < b.get_name();
-	    });
-
-  ofstream worldrebuilderfile;
-  worldrebuilderfile.open("worldrebuilder.sh");
-  worldrebuilderfile << "#!/usr/sgug/bin/bash" << endl;
-  worldrebuilderfile << "# This script should be run as your user!" << endl;
-  worldrebuilderfile << "echo 'This script is SUPER DESTRUCTIVE.'" << endl;
-  worldrebuilderfile << "echo 'So you must edit it which confirms you'" << endl;
-  worldrebuilderfile << "echo 'agree with what it will do.'" << endl;
-  worldrebuilderfile << "exit 1" << endl;
-  worldrebuilderfile << "# Some useful variables" << endl;
-  worldrebuilderfile << "build_progress_dir=" << buildprogress_p << endl;
-  worldrebuilderfile << "sgug_rse_srpm_archive_root=" << inputsrpm_p << endl;
-  worldrebuilderfile << "sgug_rse_git_root=" << gitrootdir_p << endl;
-  worldrebuilderfile << "sgug_rse_srpm_output_root=" << outputsrpm_p << endl;
-  worldrebuilderfile << "sgug_rse_rpm_output_root=" << outputrpm_p << endl;
-
-  worldrebuilderfile << "ORIG_WD=`pwd`" << endl;
-  worldrebuilderfile << "cleanUpDirs () {" << endl;
-  worldrebuilderfile << "    rm -rf ~/rpmbuild" << endl;
-  worldrebuilderfile << "    mkdir -p ~/rpmbuild/BUILD" << endl;
-  worldrebuilderfile << "    mkdir -p ~/rpmbuild/BUILDROOT" << endl;
-  worldrebuilderfile << "    mkdir -p ~/rpmbuild/RPMS" << endl;
-  worldrebuilderfile << "    mkdir -p ~/rpmbuild/SOURCES" << endl;
-  worldrebuilderfile << "    mkdir -p ~/rpmbuild/SPECS" << endl;
-  worldrebuilderfile << "    mkdir -p ~/rpmbuild/SRPMS" << endl;
-  worldrebuilderfile << "    mkdir -p $build_progress_dir" << endl;
-  worldrebuilderfile << "    mkdir -p $sgug_rse_srpm_output_root" << endl;
-  worldrebuilderfile << "    mkdir -p $sgug_rse_rpm_output_root/noarch" << endl;
-  worldrebuilderfile << "    mkdir -p $sgug_rse_rpm_output_root/mips" << endl;
-  worldrebuilderfile << "}" << endl;
-  worldrebuilderfile << "installSrpm () {" << endl;
-  worldrebuilderfile << "    packageSrpmfile=$1" << endl;
-  worldrebuilderfile << "    rpm -ivh $packageSrpmfile" << endl;
-  worldrebuilderfile << "}" << endl;
-  worldrebuilderfile << "copySgugGitPackage () {" << endl;
-  worldrebuilderfile << "    sgugGitPackageRoot=$1" << endl;
-  worldrebuilderfile << "    cp -r $sgugGitPackageRoot/* ~/rpmbuild/" << endl;
-  worldrebuilderfile << "}" << endl;
-  worldrebuilderfile << "rpmbuildPackage () {" << endl;
-  worldrebuilderfile << "    packageName=$1" << endl;
-  worldrebuilderfile << "    cd ~/rpmbuild/SPECS" << endl;
-  worldrebuilderfile << "    rpmbuild -ba \"$packageName.spec\" --nocheck 1>$build_progress_dir/$packageName.log 2>&1" << endl;
-  worldrebuilderfile << "    rpmrc=$?" << endl;
-  worldrebuilderfile << "    cd $ORIG_WD" << endl;
-  worldrebuilderfile << "    return $rpmrc" << endl;
-  worldrebuilderfile << "}" << endl;
-  worldrebuilderfile << "archiveBuiltArtefacts () {" << endl;
-  worldrebuilderfile << "    mv ~/rpmbuild/SRPMS/* $sgug_rse_srpm_output_root/" << endl;
-  worldrebuilderfile << "    if [[ -e ~/rpmbuild/RPMS/noarch ]]; then" << endl;
-  worldrebuilderfile << "	mv ~/rpmbuild/RPMS/noarch/* $sgug_rse_rpm_output_root/noarch/" << endl;
-  worldrebuilderfile << "    fi" << endl;
-  worldrebuilderfile << "    if [[ -e ~/rpmbuild/RPMS/mips ]]; then" << endl;
-  worldrebuilderfile << "	mv ~/rpmbuild/RPMS/mips/* $sgug_rse_rpm_output_root/mips/" << endl;
-  worldrebuilderfile << "    fi" << endl;
-  worldrebuilderfile << "}" << endl;
-  worldrebuilderfile << "doPackageBuild () {" << endl;
-  worldrebuilderfile << "    packageName=$1" << endl;
-  worldrebuilderfile << "    packageSrpm=$2" << endl;
-  worldrebuilderfile << "    startedFilename=\"$build_progress_dir/$packageName.started\"" << endl;
-  worldrebuilderfile << "    failedFilename=\"$build_progress_dir/$packageName.failed\"" << endl;
-  worldrebuilderfile << "    successFilename=\"$build_progress_dir/$packageName.success\"" << endl;
-  worldrebuilderfile << "    if [[ -e $startedFilename ]]; then" << endl;
-  worldrebuilderfile << "	echo \"$packageName was previously started. Skipping.\"" << endl;
-  worldrebuilderfile << "    else" << endl;
-  worldrebuilderfile << "	cleanUpDirs" << endl;
-  worldrebuilderfile << "	touch $startedFilename" << endl;
-  worldrebuilderfile << "	installSrpm \"$sgug_rse_srpm_archive_root/$packageSrpm\"" << endl;
-  worldrebuilderfile << "	copySgugGitPackage \"$sgug_rse_git_root/packages/$packageName\"" << endl;
-  worldrebuilderfile << "	rpmbuildPackage \"$packageName\"" << endl;
-  worldrebuilderfile << "	packageBuildStatus=$?" << endl;
-  worldrebuilderfile << "	if [[ $packageBuildStatus -ne 0 ]]; then" << endl;
-  worldrebuilderfile << "	    touch $failedFilename" << endl;
-  worldrebuilderfile << "	else" << endl;
-  worldrebuilderfile << "	    archiveBuiltArtefacts" << endl;
-  worldrebuilderfile << "	    touch $successFilename" << endl;
-  worldrebuilderfile << "	fi" << endl;
-  worldrebuilderfile << "    fi" << endl;
-  worldrebuilderfile << "}" << endl;
-  worldrebuilderfile << "# The package list..." << endl;
-
-  for( const sgug_rpm::specfile & spec : specs_to_rebuild ) {
-    const string & name = spec.get_name();
-    if( package_to_srpm_map.find(name) == package_to_srpm_map.end() ) {
+  int max_parallel_builds = buildjobs > 0 ? buildjobs : 1;
+  bool parallel_builds = max_parallel_builds > 1;
+  path buildwork_p = outputdir_p / "WORK";
+
+  sgug_rpm::buffered_output_file worldrebuilderfile( "worldrebuilder.sh" );
+  worldrebuilderfile << "#!/usr/sgug/bin/bash\n";
+  worldrebuilderfile << "# This script should be run as your user!\n";
+  worldrebuilderfile << "echo 'This script is SUPER DESTRUCTIVE.'\n";
+  worldrebuilderfile << "echo 'So you must edit it which confirms you'\n";
+  worldrebuilderfile << "echo 'agree with what it will do.'\n";
+  worldrebuilderfile << "exit 1\n";
+  worldrebuilderfile << "# Some useful variables\n";
+  worldrebuilderfile << "build_progress_dir=" << buildprogress_p << "\n";
+  worldrebuilderfile << "build_work_root=" << buildwork_p << "\n";
+  worldrebuilderfile << "build_manifest=" << manifest_p << "\n";
+  worldrebuilderfile << "max_parallel_builds=" << max_parallel_builds << "\n";
+  worldrebuilderfile << "sgug_rse_srpm_archive_root=" << inputsrpm_p << "\n";
+  worldrebuilderfile << "sgug_rse_git_root=" << gitrootdir_p << "\n";
+  worldrebuilderfile << "sgug_rse_srpm_output_root=" << outputsrpm_p << "\n";
+  worldrebuilderfile << "sgug_rse_rpm_output_root=" << outputrpm_p << "\n";
+
+  worldrebuilderfile << "ORIG_WD=`pwd`\n";
+  // Concurrent builds can't share ~/rpmbuild, so each gets its own topdir
+  worldrebuilderfile << "packageTopDir () {\n";
+  worldrebuilderfile << "    packageName=$1\n";
+  worldrebuilderfile << "    if [[ $max_parallel_builds -gt 1 ]]; then\n";
+  worldrebuilderfile << "	echo \"$build_work_root/$packageName\"\n";
+  worldrebuilderfile << "    else\n";
+  worldrebuilderfile << "	echo ~/rpmbuild\n";
+  worldrebuilderfile << "    fi\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "cleanUpDirs () {\n";
+  worldrebuilderfile << "    topDir=$1\n";
+  worldrebuilderfile << "    rm -rf $topDir\n";
+  worldrebuilderfile << "    mkdir -p $topDir/BUILD\n";
+  worldrebuilderfile << "    mkdir -p $topDir/BUILDROOT\n";
+  worldrebuilderfile << "    mkdir -p $topDir/RPMS\n";
+  worldrebuilderfile << "    mkdir -p $topDir/SOURCES\n";
+  worldrebuilderfile << "    mkdir -p $topDir/SPECS\n";
+  worldrebuilderfile << "    mkdir -p $topDir/SRPMS\n";
+  worldrebuilderfile << "    mkdir -p $build_progress_dir\n";
+  worldrebuilderfile << "    mkdir -p $sgug_rse_srpm_output_root\n";
+  worldrebuilderfile << "    mkdir -p $sgug_rse_rpm_output_root/noarch\n";
+  worldrebuilderfile << "    mkdir -p $sgug_rse_rpm_output_root/mips\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "installSrpm () {\n";
+  worldrebuilderfile << "    topDir=$1\n";
+  worldrebuilderfile << "    packageSrpmfile=$2\n";
+  worldrebuilderfile << "    rpm -ivh --define \"_topdir $topDir\" $packageSrpmfile\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "copySgugGitPackage () {\n";
+  worldrebuilderfile << "    topDir=$1\n";
+  worldrebuilderfile << "    sgugGitPackageRoot=$2\n";
+  worldrebuilderfile << "    cp -r $sgugGitPackageRoot/* $topDir/\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "rpmbuildPackage () {\n";
+  worldrebuilderfile << "    topDir=$1\n";
+  worldrebuilderfile << "    packageName=$2\n";
+  worldrebuilderfile << "    cd $topDir/SPECS\n";
+  worldrebuilderfile << "    rpmbuild -ba --define \"_topdir $topDir\" \"$packageName.spec\" --nocheck 1>$build_progress_dir/$packageName.log 2>&1\n";
+  worldrebuilderfile << "    rpmrc=$?\n";
+  worldrebuilderfile << "    cd $ORIG_WD\n";
+  worldrebuilderfile << "    return $rpmrc\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "archiveBuiltArtefacts () {\n";
+  worldrebuilderfile << "    topDir=$1\n";
+  worldrebuilderfile << "    mv $topDir/SRPMS/* $sgug_rse_srpm_output_root/\n";
+  worldrebuilderfile << "    if [[ -e $topDir/RPMS/noarch ]]; then\n";
+  worldrebuilderfile << "	mv $topDir/RPMS/noarch/* $sgug_rse_rpm_output_root/noarch/\n";
+  worldrebuilderfile << "    fi\n";
+  worldrebuilderfile << "    if [[ -e $topDir/RPMS/mips ]]; then\n";
+  worldrebuilderfile << "	mv $topDir/RPMS/mips/* $sgug_rse_rpm_output_root/mips/\n";
+  worldrebuilderfile << "    fi\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "doPackageBuild () {\n";
+  worldrebuilderfile << "    packageName=$1\n";
+  worldrebuilderfile << "    packageSrpm=$2\n";
+  worldrebuilderfile << "    packageFingerprint=$3\n";
+  worldrebuilderfile << "    topDir=`packageTopDir \"$packageName\"`\n";
+  worldrebuilderfile << "    startedFilename=\"$build_progress_dir/$packageName.started\"\n";
+  worldrebuilderfile << "    failedFilename=\"$build_progress_dir/$packageName.failed\"\n";
+  worldrebuilderfile << "    successFilename=\"$build_progress_dir/$packageName.success\"\n";
+  // The started marker holds the fingerprint so changed inputs restart
+  worldrebuilderfile << "    if [[ -e $startedFilename && \"`cat $startedFilename`\" == \"$packageFingerprint\" ]]; then\n";
+  worldrebuilderfile << "	echo \"$packageName was previously started. Skipping.\"\n";
+  worldrebuilderfile << "    else\n";
+  worldrebuilderfile << "	cleanUpDirs \"$topDir\"\n";
+  worldrebuilderfile << "	rm -f $failedFilename $successFilename\n";
+  worldrebuilderfile << "	echo \"$packageFingerprint\" > $startedFilename\n";
+  worldrebuilderfile << "	installSrpm \"$topDir\" \"$sgug_rse_srpm_archive_root/$packageSrpm\"\n";
+  worldrebuilderfile << "	copySgugGitPackage \"$topDir\" \"$sgug_rse_git_root/packages/$packageName\"\n";
+  worldrebuilderfile << "	rpmbuildPackage \"$topDir\" \"$packageName\"\n";
+  worldrebuilderfile << "	packageBuildStatus=$?\n";
+  worldrebuilderfile << "	if [[ $packageBuildStatus -ne 0 ]]; then\n";
+  worldrebuilderfile << "	    touch $failedFilename\n";
+  worldrebuilderfile << "	else\n";
+  worldrebuilderfile << "	    archiveBuiltArtefacts \"$topDir\"\n";
+  worldrebuilderfile << "	    touch $successFilename\n";
+  worldrebuilderfile << "	    if [[ -n \"$packageFingerprint\" ]]; then\n";
+  worldrebuilderfile << "		echo \"$packageName $packageFingerprint\" >> $build_manifest\n";
+  worldrebuilderfile << "	    fi\n";
+  worldrebuilderfile << "	fi\n";
+  worldrebuilderfile << "    fi\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "waitForBuildSlot () {\n";
+  worldrebuilderfile << "    while [[ `jobs -rp | wc -l` -ge $max_parallel_builds ]]; do\n";
+  worldrebuilderfile << "	wait -n\n";
+  worldrebuilderfile << "    done\n";
+  worldrebuilderfile << "}\n";
+  worldrebuilderfile << "# The package list, by build dependency level.\n";
+  worldrebuilderfile << "# Packages within a level don't build require each other.\n";
+
+  uint32_t current_level = 0;
+  bool first_group = true;
+  for( const sgug_rpm::build_group & group : build_schedule ) {
+    vector<string> group_builds;
+    for( const string & name : group.get_specs() ) {
+      if( package_to_srpm_map.find(name) == package_to_srpm_map.end() ||
+	  unchanged_specs.find(name) != unchanged_specs.end() ) {
+	continue;
+      }
+      const string & srpm = package_to_srpm_map[name];
+      const string & fingerprint = package_to_fingerprint_map[name];
+      group_builds.push_back( "doPackageBuild '" + name + "' '" + srpm +
+			      "' '" + fingerprint + "'" );
+    }
+    if( group_builds.size() == 0 ) {
       continue;
     }
-    const string & srpm = package_to_srpm_map[name];
-    worldrebuilderfile << "doPackageBuild '" << name << "' '" <<
-      srpm << "'" << endl;
-    //    worldrebuilderfile << "touch ~/rpmbuild/PROGRESS/" << name << ".start" <<
-    //      endl;
-    //    worldrebuilderfile << "rpmbuild -ba " << name << ".spec --nocheck" <<
-    //      endl;
-    //    worldrebuilderfile << "if [[ $? -ne 0 ]]; then" << endl;
-    //    worldrebuilderfile << "  touch ~/rpmbuild/PROGRESS/" << name <<
-    //      ".failed" << endl;
-    //    worldrebuilderfile << "fi" << endl;
-    //    worldrebuilderfile << "touch ~/rpmbuild/PROGRESS/" << name << ".done" <<
-    //      endl;
+
+    if( first_group || group.get_level() != current_level ) {
+      if( !first_group && parallel_builds ) {
+	worldrebuilderfile << "wait\n";
+      }
+      current_level = group.get_level();
+      first_group = false;
+      worldrebuilderfile << "# Level " << current_level << "\n";
+    }
+
+    if( group_builds.size() > 1 ) {
+      worldrebuilderfile << "# Build dependency cycle, built in sequence\n";
+    }
+    if( parallel_builds ) {
+      worldrebuilderfile << "waitForBuildSlot\n";
+      worldrebuilderfile << "(";
+      for( size_t i = 0 ; i < group_builds.size() ; ++i ) {
+	worldrebuilderfile << (i > 0 ? "; " : " ") << group_builds[i];
+      }
+      worldrebuilderfile << " ) &\n";
+    }
+    else {
+      for( const string & group_build : group_builds ) {
+	worldrebuilderfile << group_build << "\n";
+      }
+    }
+  }
+  if( parallel_builds && !first_group ) {
+    worldrebuilderfile << "wait\n";
+  }
+
+  if( !worldrebuilderfile.commit() ) {
+    exit(EXIT_FAILURE);
   }
 
-  worldrebuilderfile.close();
+  sgug_rpm::report_run_stats();
 
   return 0;
 }
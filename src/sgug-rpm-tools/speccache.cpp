@@ -0,0 +1,184 @@
+#include "speccache.hpp"
+#include "digest.hpp"
+#include "serialization.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <rpm/rpmmacro.h>
+
+using std::cerr;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::optional;
+using std::string;
+using std::to_string;
+
+using std::filesystem::path;
+
+namespace fs = std::filesystem;
+
+static const uint32_t speccache_magic = 0x43534753; // "SGSC"
+static const uint32_t speccache_version = 2;
+
+namespace sgug_rpm {
+
+  specfile_cache::specfile_cache( string cachepath,
+				  string macro_fingerprint )
+    : _cachepath(cachepath),
+      _macro_fingerprint(macro_fingerprint),
+      _dirty(false),
+      _hits(0),
+      _misses(0) {}
+
+  void specfile_cache::load() {
+    _entries.clear();
+    if( _macro_fingerprint.empty() ) {
+      return;
+    }
+    ifstream input( _cachepath, std::ios::binary );
+    if( !input ) {
+      return;
+    }
+    string contents( (std::istreambuf_iterator<char>(input)),
+		     std::istreambuf_iterator<char>() );
+    serial_reader reader( contents );
+
+    uint32_t magic, version, num_entries;
+    string fingerprint;
+    if( !reader.get_u32(magic) || magic != speccache_magic ||
+	!reader.get_u32(version) || version != speccache_version ||
+	!reader.get_string(fingerprint) || fingerprint != _macro_fingerprint ||
+	!reader.get_u32(num_entries) ) {
+      // Stale or foreign - rewrite it on save
+      _dirty = true;
+      return;
+    }
+    for( uint32_t i = 0 ; i < num_entries ; ++i ) {
+      string spec_path;
+      cache_entry entry;
+      if( !reader.get_string(spec_path) ||
+	  !reader.get_string(entry.content_hash) ||
+	  !deserialize_specfile(reader, entry.spec) ) {
+	cerr << "Ignoring truncated spec cache " << _cachepath << endl;
+	_entries.clear();
+	_dirty = true;
+	return;
+      }
+      _entries.emplace( spec_path, entry );
+    }
+  }
+
+  bool specfile_cache::save() {
+    if( !_dirty || _macro_fingerprint.empty() ) {
+      return true;
+    }
+    string contents;
+    serial_writer writer( contents );
+    writer.put_u32( speccache_magic );
+    writer.put_u32( speccache_version );
+    writer.put_string( _macro_fingerprint );
+    writer.put_u32( _entries.size() );
+    for( auto & entry : _entries ) {
+      writer.put_string( entry.first );
+      writer.put_string( entry.second.content_hash );
+      serialize_specfile( entry.second.spec, writer );
+    }
+
+    path cache_p = {_cachepath};
+    std::error_code ec;
+    if( cache_p.has_parent_path() ) {
+      fs::create_directories( cache_p.parent_path(), ec );
+    }
+    // Write aside then rename so a concurrent reader never sees half a file
+    path tmp_p = cache_p;
+    tmp_p += ".tmp";
+    {
+      ofstream output( tmp_p, std::ios::binary | std::ios::trunc );
+      output.write( contents.data(), contents.size() );
+      if( !output ) {
+	cerr << "Failed writing spec cache " << tmp_p << endl;
+	fs::remove( tmp_p, ec );
+	return false;
+      }
+    }
+    fs::rename( tmp_p, cache_p, ec );
+    if( ec ) {
+      cerr << "Failed renaming spec cache into place " << cache_p << endl;
+      return false;
+    }
+    _dirty = false;
+    return true;
+  }
+
+  optional<specfile> specfile_cache::lookup( const string & spec_path,
+					     const string & content_hash ) {
+    auto finder = _entries.find( spec_path );
+    if( finder == _entries.end() ||
+	finder->second.content_hash != content_hash ) {
+      _misses++;
+      return {};
+    }
+    _hits++;
+    return { finder->second.spec };
+  }
+
+  void specfile_cache::store( const string & spec_path,
+			      const string & content_hash,
+			      const specfile & spec ) {
+    _entries[spec_path] = cache_entry{ content_hash, spec };
+    _dirty = true;
+  }
+
+  string default_speccache_path() {
+    return default_cache_path( "speccache.bin" );
+  }
+
+  // The global macro table as rpm dumps it, less the flag on each
+  // definition saying whether it's been expanded yet - that depends on
+  // what ran before, not on what a spec would expand to. Definitions
+  // start "%3d" level then '=' (used) or ':' before the name.
+  static bool digest_macro_table( digest_h & digest ) {
+    FILE * dump = tmpfile();
+    if( dump == NULL ) {
+      return false;
+    }
+    rpmDumpMacroTable( NULL, dump );
+    bool ok = !ferror(dump) && fseek( dump, 0, SEEK_SET ) == 0;
+    string line;
+    int c;
+    while( ok && (c = fgetc(dump)) != EOF ) {
+      line.push_back( (char)c );
+      if( c != '\n' ) {
+	continue;
+      }
+      if( line.size() > 4 && line[3] == '=' && line[4] == ' ' ) {
+	line[3] = ':';
+      }
+      digest.update( line );
+      line.clear();
+    }
+    digest.update( line );
+    ok = ok && !ferror(dump);
+    fclose(dump);
+    return ok;
+  }
+
+  string compute_spec_macro_fingerprint( rpmSpecFlags flags ) {
+    digest_h digest;
+    string flags_str = to_string(flags);
+    digest.update( flags_str );
+    if( !digest_macro_table( digest ) ) {
+      cerr << "Failed reading the rpm macro table, not using the spec cache" <<
+	endl;
+      return string();
+    }
+    return digest.final_hex();
+  }
+
+}
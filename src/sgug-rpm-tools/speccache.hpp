@@ -0,0 +1,64 @@
+#ifndef SPECCACHE_HPP
+#define SPECCACHE_HPP
+
+#include "specfile.hpp"
+
+#include <string>
+#include <optional>
+#include <unordered_map>
+
+#include <rpm/rpmspec.h>
+
+namespace sgug_rpm {
+
+  // Persistent map of spec path -> (content hash, parsed specfile).
+  // The whole cache is discarded when the macro fingerprint it was
+  // written with doesn't match the current one; with no fingerprint
+  // it is neither read nor written.
+  //
+  // Only the spec itself is hashed: a change to a file it %includes
+  // or loads is not noticed. Rebuild the cache (--refreshspeccache)
+  // after editing one.
+  class specfile_cache {
+  private:
+    struct cache_entry {
+      std::string content_hash;
+      specfile spec;
+    };
+
+    std::string _cachepath;
+    std::string _macro_fingerprint;
+    std::unordered_map<std::string,cache_entry> _entries;
+    bool _dirty;
+    uint32_t _hits;
+    uint32_t _misses;
+
+  public:
+    specfile_cache( std::string cachepath,
+		    std::string macro_fingerprint );
+
+    const std::string & get_cachepath() const { return _cachepath; };
+    uint32_t get_hits() const { return _hits; };
+    uint32_t get_misses() const { return _misses; };
+
+    // Missing or stale cache files just give an empty cache
+    void load();
+    bool save();
+
+    std::optional<specfile> lookup( const std::string & path,
+				    const std::string & content_hash );
+    void store( const std::string & path,
+		const std::string & content_hash,
+		const specfile & spec );
+  };
+
+  // $XDG_CACHE_HOME/sgug-rpm-tools/speccache.bin, falling back to ~/.cache
+  std::string default_speccache_path();
+
+  // Hash of the flags and of every macro defined when it's called -
+  // the macro files, rpmrc and --define - so a change to any of them
+  // invalidates the cache. Empty if the macro table couldn't be read.
+  std::string compute_spec_macro_fingerprint( rpmSpecFlags flags );
+}
+
+#endif
@@ -1,4 +1,9 @@
 #include "specfile.hpp"
+#include "dependencyset.hpp"
+#include "speccache.hpp"
+#include "digest.hpp"
+#include "runstats.hpp"
+#include "workerpool.hpp"
 
 #include <iostream>
 #include <filesystem>
@@ -16,6 +21,7 @@
 using std::cout;
 using std::cerr;
 using std::endl;
+using std::optional;
 using std::string;
 using std::vector;
 using std::unordered_map;
@@ -64,11 +70,56 @@ namespace sgug_rpm {
       _packages(packages),
       _build_deps(build_deps) {}
 
+  void serialize_specfile( const specfile & source,
+			   serial_writer & writer )
+  {
+    writer.put_string( source.get_filepath() );
+    writer.put_string( source.get_name() );
+    writer.put_strings( source.get_packages() );
+    const unordered_map<string,vector<string>> & build_deps =
+      source.get_build_deps();
+    writer.put_u32( build_deps.size() );
+    for( auto & entry : build_deps ) {
+      writer.put_string( entry.first );
+      writer.put_strings( entry.second );
+    }
+  }
+
+  bool deserialize_specfile( serial_reader & reader,
+			     specfile & dest )
+  {
+    string filepath;
+    string name;
+    vector<string> packages;
+    uint32_t num_build_deps;
+    if( !reader.get_string(filepath) ||
+	!reader.get_string(name) ||
+	!reader.get_strings(packages) ||
+	!reader.get_u32(num_build_deps) ) {
+      return false;
+    }
+    unordered_map<string,vector<string>> build_deps;
+    for( uint32_t i = 0 ; i < num_build_deps ; ++i ) {
+      string pkg_name;
+      vector<string> deps;
+      if( !reader.get_string(pkg_name) || !reader.get_strings(deps) ) {
+	return false;
+      }
+      build_deps.emplace( pkg_name, deps );
+    }
+
+    dest = specfile{ filepath, name, packages, build_deps };
+
+    return true;
+  }
+
   bool read_specfile( const string & path,
 		      rpmSpecFlags flags,
 		      specfile & dest,
 		      progress_printer & pprinter )
   {
+    static stat_phase parse_phase( "read_specfile" );
+    scoped_timer timer( parse_phase );
     rpmspec_h spec_h( path.c_str(), flags, NULL );
     if( !spec_h.this_spec ) {
       pprinter.reset();
@@ -95,6 +146,13 @@ namespace sgug_rpm {
       build_deps.emplace(pkg_name, vector<string>());
     }
 
+    // BuildRequires live on the source package, so attach them to the
+    // spec's main package entry
+    Header source_header = rpmSpecSourceHeader(spec_h.this_spec);
+    if( source_header != NULL && !first ) {
+      rpmds_read_requires( source_header, build_deps[spec_name] );
+    }
+
     dest = specfile{ path, spec_name, packages, build_deps };
 
     return true;
@@ -107,16 +165,82 @@ namespace sgug_rpm {
 		       vector<string> & error_specfiles,
 		       progress_printer & pprinter )
   {
-    for( const string & spec_filename : paths ) {
-      specfile specfile;
-      popt_context.reset_rpm_macros();
-      if( read_specfile(spec_filename, flags, specfile, pprinter) ) {
-	out_specfiles.push_back( specfile );
+    read_specfiles( popt_context, paths, flags, 1, NULL,
+		    out_specfiles, error_specfiles, pprinter );
+  }
+
+  void read_specfiles( poptcontext_h & popt_context,
+		       const vector<string> & paths,
+		       rpmSpecFlags flags,
+		       unsigned int jobs,
+		       specfile_cache * cache,
+		       vector<specfile> & out_specfiles,
+		       vector<string> & error_specfiles,
+		       progress_printer & pprinter )
+  {
+    static stat_phase read_phase( "read_specfiles" );
+    static stat_counter cache_hits( "spec cache hits" );
+    static stat_counter specs_parsed( "specs parsed" );
+    scoped_timer timer( read_phase );
+    // Results stream back in any order, slot them by index so
+    // output order matches the input paths whatever the job count
+    vector<specfile> parsed( paths.size() );
+    vector<bool> parsed_ok( paths.size(), false );
+
+    vector<string> content_hashes( paths.size() );
+    vector<size_t> to_parse;
+    for( size_t i = 0 ; i < paths.size() ; ++i ) {
+      if( cache != NULL ) {
+	optional<string> hash_opt = digest_file( paths[i] );
+	if( hash_opt ) {
+	  content_hashes[i] = *hash_opt;
+	  optional<specfile> cached_opt = cache->lookup( paths[i],
+							 content_hashes[i] );
+	  if( cached_opt ) {
+	    parsed[i] = *cached_opt;
+	    parsed_ok[i] = true;
+	    continue;
+	  }
+	}
+      }
+      to_parse.push_back(i);
+    }
+    cache_hits.add( paths.size() - to_parse.size() );
+    specs_parsed.add( to_parse.size() );
+
+    run_forked_pool( to_parse.size(), jobs,
+		     [&]( size_t item, string & result ) -> bool {
+		       specfile specfile;
+		       popt_context.reset_rpm_macros();
+		       if( !read_specfile(paths[to_parse[item]], flags,
+					  specfile, pprinter) ) {
+			 return false;
+		       }
+		       serial_writer writer( result );
+		       serialize_specfile( specfile, writer );
+		       return true;
+		     },
+		     [&]( size_t item, bool success, const string & result ) {
+		       size_t i = to_parse[item];
+		       if( success ) {
+			 serial_reader reader( result );
+			 parsed_ok[i] = deserialize_specfile( reader,
+							      parsed[i] );
+		       }
+		       if( parsed_ok[i] && cache != NULL &&
+			   !content_hashes[i].empty() ) {
+			 cache->store( paths[i], content_hashes[i], parsed[i] );
+		       }
+		       pprinter.accept_progress();
+		     } );
+
+    for( size_t i = 0 ; i < paths.size() ; ++i ) {
+      if( parsed_ok[i] ) {
+	out_specfiles.push_back( parsed[i] );
       }
       else {
-	error_specfiles.push_back( spec_filename );
+	error_specfiles.push_back( paths[i] );
       }
-      pprinter.accept_progress();
     }
     pprinter.reset();
   }
@@ -2,6 +2,7 @@
 #define SPECFILES_HPP
 
 #include "helpers.hpp"
+#include "serialization.hpp"
 
 #include <string>
 #include <vector>
@@ -10,6 +11,8 @@
 #include <rpm/rpmspec.h>
 
 namespace sgug_rpm {
+  class specfile_cache;
+
   class specfile {
   private:
     std::string _filepath;
@@ -30,6 +33,12 @@ namespace sgug_rpm {
     const std::unordered_map<std::string,std::vector<std::string>> & get_build_deps() const { return _build_deps; };
   };
 
+  void serialize_specfile( const specfile & source,
+			   serial_writer & writer );
+
+  bool deserialize_specfile( serial_reader & reader,
+			     specfile & dest );
+
   bool read_specfile( const std::string & path,
 		      rpmSpecFlags flags,
 		      specfile & dest,
@@ -42,6 +51,17 @@ namespace sgug_rpm {
 		       std::vector<std::string> & error_specfiles,
 		       sgug_rpm::progress_printer & pprinter );
 
+  // Parse using up to jobs forked worker processes. When a cache is
+  // passed, only specs whose contents changed are handed to librpm.
+  void read_specfiles( poptcontext_h & popt_context,
+		       const std::vector<std::string> & paths,
+		       rpmSpecFlags flags,
+		       unsigned int jobs,
+		       specfile_cache * cache,
+		       std::vector<specfile> & out_specfiles,
+		       std::vector<std::string> & error_specfiles,
+		       sgug_rpm::progress_printer & pprinter );
+
   void read_rpmbuild_specfiles( sgug_rpm::poptcontext_h & popt_context,
 				rpmSpecFlags flags,
 				std::vector<specfile> & out_specfiles,
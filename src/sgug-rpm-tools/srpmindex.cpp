@@ -0,0 +1,100 @@
+#include "srpmindex.hpp"
+#include "mappedrpm.hpp"
+#include "runstats.hpp"
+#include "standalonerpm.hpp"
+#include "workerpool.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::optional;
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::vector;
+
+using std::filesystem::path;
+
+namespace fs = std::filesystem;
+
+namespace sgug_rpm {
+
+  bool build_srpm_index( const bool verbose,
+			 const string & srpm_dir,
+			 unsigned int jobs,
+			 unordered_map<string,string> & name_to_srpm,
+			 progress_printer & pprinter )
+  {
+    static stat_phase index_phase( "srpm index" );
+    static stat_counter srpms_read( "srpm headers read" );
+    scoped_timer timer( index_phase );
+    path srpm_dir_p = {srpm_dir};
+    if( !fs::exists(srpm_dir_p) || !fs::is_directory(srpm_dir_p) ) {
+      return false;
+    }
+
+    vector<path> candidates;
+    for( const auto & entry : fs::directory_iterator(srpm_dir_p) ) {
+      path entry_path = entry.path();
+      if( !entry.is_directory() &&
+	  str_ends_with(entry_path.filename(), ".src.rpm") ) {
+	candidates.push_back(entry_path);
+      }
+    }
+    std::sort( candidates.begin(), candidates.end() );
+    srpms_read.add( candidates.size() );
+
+    vector<string> names( candidates.size() );
+    run_forked_pool( candidates.size(), jobs,
+		     [&]( size_t item, string & result ) -> bool {
+		       // Only the name is needed - skip payload + digests
+		       mapped_rpm_h mapped_rpm( candidates[item] );
+		       if( mapped_rpm.is_valid() ) {
+			 optional<string_view> name_opt =
+			   mapped_rpm.get_string( RPMTAG_NAME );
+			 if( name_opt ) {
+			   result.assign( *name_opt );
+			   return true;
+			 }
+		       }
+		       standalonerpm sarpm;
+		       if( !read_standalonerpm( verbose, candidates[item],
+						sarpm, false, false ) ) {
+			 return false;
+		       }
+		       result = sarpm.get_name();
+		       return true;
+		     },
+		     [&]( size_t item, bool success, const string & result ) {
+		       if( success ) {
+			 names[item] = result;
+		       }
+		       else {
+			 cerr << "# Couldn't read SRPM " <<
+			   candidates[item] << endl;
+		       }
+		       pprinter.accept_progress();
+		     } );
+    pprinter.reset();
+
+    for( size_t i = 0 ; i < candidates.size() ; ++i ) {
+      if( names[i].empty() ) {
+	continue;
+      }
+      string filename = candidates[i].filename();
+      auto inserted = name_to_srpm.emplace( names[i], filename );
+      if( !inserted.second && verbose ) {
+	cout << "# Ignoring " << filename << ", already have " <<
+	  inserted.first->second << " for " << names[i] << endl;
+      }
+    }
+
+    return true;
+  }
+
+}
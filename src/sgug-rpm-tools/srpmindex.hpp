@@ -0,0 +1,22 @@
+#ifndef SRPMINDEX_HPP
+#define SRPMINDEX_HPP
+
+#include "helpers.hpp"
+
+#include <string>
+#include <unordered_map>
+
+namespace sgug_rpm {
+
+  // Scan srpm_dir once, reading the header of every .src.rpm in it
+  // exactly once (across up to jobs worker processes), and fill
+  // name_to_srpm with package name -> SRPM filename. Where several
+  // SRPMs carry the same name the first filename in sorted order wins.
+  bool build_srpm_index( const bool verbose,
+			 const std::string & srpm_dir,
+			 unsigned int jobs,
+			 std::unordered_map<std::string,std::string> & name_to_srpm,
+			 progress_printer & pprinter );
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "standalonerpm.hpp"
+#include "mappedrpm.hpp"
 #include "helpers.hpp"
 #include "dependencyset.hpp"
 
@@ -9,8 +10,11 @@
 #include <unordered_set>
 
 #include <fcntl.h>
+#include <arpa/inet.h>
 
 // rpm bits
+#include <rpm/header.h>
+#include <rpm/rpmio.h>
 #include <rpm/rpmlib.h>
 #include <rpm/rpmcli.h>
 #include <rpm/rpmdb.h>
@@ -29,16 +33,46 @@ using std::vector;
 using std::unordered_set;
 using std::unordered_map;
 
+// On-disk package layout: 96 byte lead, signature header padded to a
+// multiple of 8 bytes, then the main header, then the payload.
+static const size_t rpm_lead_size = 96;
+static const unsigned char rpm_lead_magic[] = { 0xed, 0xab, 0xee, 0xdb };
+static const unsigned char rpm_header_magic[] = { 0x8e, 0xad, 0xe8, 0x01 };
+static const size_t rpm_header_intro_size = 16;
+static const size_t rpm_header_entry_size = 16;
+
 namespace sgug_rpm {
 
+  // Position fd at the start of the main header without verifying anything
+  static bool skip_lead_and_signature( FD_t fd ) {
+    unsigned char lead[rpm_lead_size];
+    if( Fread(lead, 1, sizeof(lead), fd) != (ssize_t)sizeof(lead) ||
+	memcmp(lead, rpm_lead_magic, sizeof(rpm_lead_magic)) != 0 ) {
+      return false;
+    }
+    unsigned char intro[rpm_header_intro_size];
+    if( Fread(intro, 1, sizeof(intro), fd) != (ssize_t)sizeof(intro) ||
+	memcmp(intro, rpm_header_magic, sizeof(rpm_header_magic)) != 0 ) {
+      return false;
+    }
+    uint32_t index_length, data_length;
+    memcpy(&index_length, intro + 8, sizeof(index_length));
+    memcpy(&data_length, intro + 12, sizeof(data_length));
+    size_t sig_size = ntohl(index_length) * rpm_header_entry_size +
+      ntohl(data_length);
+    // The signature header (intro included) is padded to 8 bytes
+    size_t padding = (8 - ((rpm_header_intro_size + sig_size) % 8)) % 8;
+    return Fseek(fd, sig_size + padding, SEEK_CUR) >= 0;
+  }
+
   standalonerpm::standalonerpm( string name,
 				string rpmfile,
 				vector<string> provides,
 				vector<string> requires )
-    : _name(name),
-      _rpmfile(rpmfile),
-      _provides(provides),
-      _requires(requires) {}
+    : _name(std::move(name)),
+      _rpmfile(std::move(rpmfile)),
+      _provides(std::move(provides)),
+      _requires(std::move(requires)) {}
 
   bool read_standalonerpm( const bool verbose, const string & rpmpath,
 			   standalonerpm & dest )
@@ -49,6 +83,14 @@ namespace sgug_rpm {
   bool read_standalonerpm( const bool verbose, const string & rpmpath,
 			   standalonerpm & dest,
 			   const bool read_deps )
+  {
+    return read_standalonerpm( verbose, rpmpath, dest, read_deps, true );
+  }
+
+  bool read_standalonerpm( const bool verbose, const string & rpmpath,
+			   standalonerpm & dest,
+			   const bool read_deps,
+			   const bool verify )
   {
     bool returnCode = false;
     Header h, sig;
@@ -61,13 +103,26 @@ namespace sgug_rpm {
       return false;
     }
 
-    rpmts_h rpmts_helper;
+    if( verify ) {
+      rpmts_h rpmts_helper;
 
-    rc = rpmReadPackageFile( rpmts_helper.ts, fd, rpmpath_c_str, &h);
-    if (rc != RPMRC_OK) {
-      cerr << "Failed rpmReadPackageFile" << endl;
-      Fclose(fd);
-      return false;
+      rc = rpmReadPackageFile( rpmts_helper.ts, fd, rpmpath_c_str, &h);
+      if (rc != RPMRC_OK) {
+	cerr << "Failed rpmReadPackageFile" << endl;
+	Fclose(fd);
+	return false;
+      }
+    }
+    else {
+      h = NULL;
+      if( skip_lead_and_signature(fd) ) {
+	h = headerRead(fd, HEADER_MAGIC_YES);
+      }
+      if( h == NULL ) {
+	cerr << "Failed reading header of " << rpmpath << endl;
+	Fclose(fd);
+	return false;
+      }
     }
 
     const char * name = headerGetString(h, RPMTAG_NAME);
@@ -81,7 +136,8 @@ namespace sgug_rpm {
 				 requires );
     }
 
-    dest = {string(name), rpmpath, provides, requires };
+    dest = {string(name), rpmpath, std::move(provides),
+	    std::move(requires) };
 
     returnCode = true;
     
@@ -99,7 +155,9 @@ namespace sgug_rpm {
   {
     for( const string & rpmpath : rpmpaths ) {
       standalonerpm one_rpm;
-      if( read_standalonerpm( verbose, rpmpath, one_rpm ) ) {
+      // Bulk scans decode straight from a mapping, librpm is the fallback
+      if( read_standalonerpm_mapped( verbose, rpmpath, one_rpm, false ) ||
+	  read_standalonerpm( verbose, rpmpath, one_rpm ) ) {
 	out_rpms.emplace_back( one_rpm );
       }
       else {
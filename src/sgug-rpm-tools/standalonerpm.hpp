@@ -37,6 +37,16 @@ namespace sgug_rpm {
 			   standalonerpm & dest,
 			   const bool read_deps );
 
+  // With verify false only the lead and signature sizes are parsed and
+  // skipped, then the main header is read on its own - no payload and no
+  // signature/digest checks. Dependency tags are only decoded when
+  // read_deps is set.
+  bool read_standalonerpm( const bool verbose,
+			   const std::string & rpmpath,
+			   standalonerpm & dest,
+			   const bool read_deps,
+			   const bool verify );
+
   void read_standalonerpms( const bool verbose,
 			    const std::vector<std::string> & rpmpaths,
 			    std::vector<standalonerpm> & out_rpms,
@@ -0,0 +1,27 @@
+#include "stringinterner.hpp"
+
+using std::optional;
+using std::string_view;
+
+namespace sgug_rpm {
+
+  uint32_t string_interner::intern( string_view value ) {
+    auto finder = _ids.find( value );
+    if( finder != _ids.end() ) {
+      return finder->second;
+    }
+    uint32_t id = _strings.size();
+    const std::string & stored = _strings.emplace_back( value );
+    _ids.emplace( string_view(stored), id );
+    return id;
+  }
+
+  optional<uint32_t> string_interner::find( string_view value ) const {
+    auto finder = _ids.find( value );
+    if( finder == _ids.end() ) {
+      return {};
+    }
+    return { finder->second };
+  }
+
+}
@@ -0,0 +1,42 @@
+#ifndef STRINGINTERNER_HPP
+#define STRINGINTERNER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace sgug_rpm {
+
+  // Maps each distinct string to a dense uint32 id (0, 1, 2...) so
+  // package names / provides / requires can be compared and used as
+  // array indexes instead of being re-hashed on every lookup.
+  class string_interner {
+  private:
+    // deque never relocates elements, so the views keying _ids stay valid
+    std::deque<std::string> _strings;
+    std::unordered_map<std::string_view,uint32_t> _ids;
+
+  public:
+    static const uint32_t no_id = std::numeric_limits<uint32_t>::max();
+
+    string_interner() {};
+    string_interner( const string_interner & ) = delete;
+    string_interner & operator=( const string_interner & ) = delete;
+    // Moving hands over the deque's blocks, so the views stay good
+    string_interner( string_interner && ) = default;
+    string_interner & operator=( string_interner && ) = default;
+
+    uint32_t intern( std::string_view value );
+    std::optional<uint32_t> find( std::string_view value ) const;
+
+    const std::string & get_string( uint32_t id ) const { return _strings[id]; };
+    size_t size() const { return _strings.size(); };
+  };
+
+}
+
+#endif
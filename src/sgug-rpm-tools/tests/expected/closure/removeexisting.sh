@@ -0,0 +1,8 @@
+#!/usr/sgug/bin/bash
+# This script should be run under sudo!
+# (and may not work properly due to perl circular dependencies)
+# Should remove binutils binutils-2.23.2-1.sgugmips.rpm
+# Should remove gcc gcc-9.2.0-1.sgugmips.rpm
+# Should remove perl perl-5.30.1-1.sgugmips.rpm
+# Should remove perl-libs perl-libs-5.30.1-1.sgugmips.rpm
+rpm -evh binutils gcc perl perl-libs
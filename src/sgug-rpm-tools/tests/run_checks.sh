@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Runs the tools against the small install in fixture/ and compares
+# what they print and write with expected/. "make check" runs it; by
+# hand it's
+#
+#   run_checks.sh BUILDDIR TESTSDIR
+#
+# After a deliberate change of output, REGENERATE=1 copies what the
+# tools gave over expected/ instead of comparing.
+
+builddir=$1
+testsdir=$2
+if [ -z "$builddir" ] || [ -z "$testsdir" ]; then
+    echo "usage: run_checks.sh BUILDDIR TESTSDIR" >&2
+    exit 2
+fi
+
+fixture=$testsdir/fixture/packages.fixture
+gitroot=$testsdir/fixture
+expected=$testsdir/expected
+work=$builddir/check-output
+# Kept short, socket paths are limited to ~100 characters
+socket=${TMPDIR:-/tmp}/sgug-rpm-tools-check.$$.sock
+
+rm -rf "$work"
+mkdir -p "$work" || exit 1
+
+failures=0
+
+# The progress spinner is cursor-left + a character on stdout
+strip_progress() {
+    esc=$(printf '\033')
+    sed -e "s/${esc}\[1D[-|\\/]\{0,1\}//g"
+}
+
+# compare NAME - checks $work/NAME against $expected/NAME
+compare() {
+    if [ -n "$REGENERATE" ]; then
+	mkdir -p "$(dirname "$expected/$1")"
+	cp "$work/$1" "$expected/$1"
+    elif ! diff -u "$expected/$1" "$work/$1"; then
+	echo "FAIL: $1" >&2
+	failures=$((failures + 1))
+    fi
+}
+
+# minimal_set DIR [OPTION...] - a sgug_minimal_computer run in $work/DIR
+minimal_set() {
+    dir=$1
+    shift
+    mkdir -p "$work/$dir"
+    (cd "$work/$dir" &&
+	"$builddir/sgug_minimal_computer" --fixture "$fixture" \
+	    --gitroot "$gitroot" "$@" 2>&1) | strip_progress > "$work/$dir.out"
+    compare "$dir.out"
+    for output in missingdeps.txt cyclegroups.txt leaveinstalled.txt \
+	removeexisting.sh footprint.txt; do
+	if [ -f "$work/$dir/$output" ]; then
+	    compare "$dir/$output"
+	fi
+    done
+}
+
+minimal_set minimal --footprint --why zlib
+minimal_set closure --closure --footprint --why readline
+
+# Each query on its own, then the last two as one
+{
+    "$builddir/sgug_impact_query" --fixture "$fixture" glibc zlib gcc nosuch
+    "$builddir/sgug_impact_query" --fixture "$fixture" --union perl binutils
+} 2>&1 | strip_progress > "$work/impact.out"
+compare impact.out
+
+"$builddir/sgug_rpm_server" --fixture "$fixture" --gitroot "$gitroot" \
+    --socket "$socket" > "$work/server.log" 2>&1 &
+server_pid=$!
+tries=0
+until "$builddir/sgug_rpm_server" --socket "$socket" --send ping \
+    > /dev/null 2>&1; do
+    tries=$((tries + 1))
+    if [ $tries -ge 30 ] || ! kill -0 $server_pid 2> /dev/null; then
+	echo "FAIL: sgug_rpm_server didn't start, see $work/server.log" >&2
+	kill $server_pid 2> /dev/null
+	exit 1
+    fi
+    sleep 1
+done
+for request in "whatprovides /usr/sgug/bin/sh" "whatprovides libz.so.1" \
+    "whatprovides gtar" "whatprovides libacl.so.1" "builddeps rpm" \
+    "buildorder" "minimalset" "minimalset sudo" "impact readline" \
+    "impact nosuch" "bogus"; do
+    echo "> $request"
+    "$builddir/sgug_rpm_server" --socket "$socket" --send "$request" 2>&1
+done > "$work/server.out"
+"$builddir/sgug_rpm_server" --socket "$socket" --send shutdown > /dev/null 2>&1
+wait $server_pid
+rm -f "$socket"
+compare server.out
+
+if [ $failures -gt 0 ]; then
+    echo "$failures check(s) failed, outputs are in $work" >&2
+    exit 1
+fi
+rm -rf "$work"
+exit 0
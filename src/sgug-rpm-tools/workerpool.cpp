@@ -0,0 +1,210 @@
+#include "workerpool.hpp"
+#include "serialization.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace sgug_rpm {
+
+  // Record framing on the pipe: u64 item, u8 success, u32 length, payload
+  static const size_t record_header_size =
+    sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+  static bool write_fully( int fd, const char * data, size_t len ) {
+    while( len > 0 ) {
+      ssize_t written = write( fd, data, len );
+      if( written < 0 ) {
+	if( errno == EINTR ) {
+	  continue;
+	}
+	return false;
+      }
+      data += written;
+      len -= written;
+    }
+    return true;
+  }
+
+  static void run_worker( int fd, size_t first_item, size_t num_items,
+			  unsigned int stride, const forked_worker & worker ) {
+    string record;
+    string result;
+    for( size_t item = first_item ; item < num_items ; item += stride ) {
+      result.clear();
+      bool success = worker( item, result );
+      record.clear();
+      serial_writer writer( record );
+      writer.put_u64( item );
+      writer.put_u8( success ? 1 : 0 );
+      writer.put_string( result );
+      if( !write_fully( fd, record.data(), record.size() ) ) {
+	_exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  // Hand any complete records in buffer to the collector, keeping the tail
+  static void drain_records( string & buffer,
+			     vector<bool> & collected,
+			     const forked_collector & collector ) {
+    size_t offset = 0;
+    while( buffer.size() - offset >= record_header_size ) {
+      serial_reader reader( buffer.data() + offset, buffer.size() - offset );
+      uint64_t item;
+      uint8_t success;
+      uint32_t len;
+      reader.get_u64( item );
+      reader.get_u8( success );
+      reader.get_u32( len );
+      if( reader.remaining() < len ) {
+	break;
+      }
+      string result( buffer.data() + offset + record_header_size, len );
+      offset += record_header_size + len;
+      collected[item] = true;
+      collector( item, success != 0, result );
+    }
+    buffer.erase( 0, offset );
+  }
+
+  bool run_forked_pool( size_t num_items,
+			unsigned int jobs,
+			const forked_worker & worker,
+			const forked_collector & collector ) {
+    if( jobs <= 1 || num_items <= 1 ) {
+      string result;
+      for( size_t item = 0 ; item < num_items ; ++item ) {
+	result.clear();
+	bool success = worker( item, result );
+	collector( item, success, result );
+      }
+      return true;
+    }
+
+    unsigned int num_workers = jobs;
+    if( num_workers > num_items ) {
+      num_workers = num_items;
+    }
+
+    // Anything still buffered would otherwise be emitted once per child
+    cout.flush();
+    cerr.flush();
+    fflush(NULL);
+
+    vector<pid_t> children;
+    vector<struct pollfd> pollfds;
+    for( unsigned int w = 0 ; w < num_workers ; ++w ) {
+      int fds[2];
+      if( pipe(fds) != 0 ) {
+	cerr << "Failed creating worker pipe" << endl;
+	break;
+      }
+      pid_t pid = fork();
+      if( pid < 0 ) {
+	cerr << "Failed forking worker" << endl;
+	close(fds[0]);
+	close(fds[1]);
+	break;
+      }
+      if( pid == 0 ) {
+	for( struct pollfd & pfd : pollfds ) {
+	  close(pfd.fd);
+	}
+	close(fds[0]);
+	run_worker( fds[1], w, num_items, num_workers, worker );
+	close(fds[1]);
+	// Skip atexit handlers + static destructors that belong to the parent
+	_exit(EXIT_SUCCESS);
+      }
+      close(fds[1]);
+      children.push_back(pid);
+      struct pollfd pfd;
+      pfd.fd = fds[0];
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      pollfds.push_back(pfd);
+    }
+
+    vector<bool> collected( num_items, false );
+    vector<string> buffers( pollfds.size() );
+    size_t open_pipes = pollfds.size();
+    char readbuf[65536];
+
+    while( open_pipes > 0 ) {
+      int ready = poll( pollfds.data(), pollfds.size(), -1 );
+      if( ready < 0 ) {
+	if( errno == EINTR ) {
+	  continue;
+	}
+	cerr << "Failed polling workers" << endl;
+	break;
+      }
+      for( size_t p = 0 ; p < pollfds.size() ; ++p ) {
+	struct pollfd & pfd = pollfds[p];
+	if( pfd.fd < 0 || pfd.revents == 0 ) {
+	  continue;
+	}
+	ssize_t num_read = read( pfd.fd, readbuf, sizeof(readbuf) );
+	if( num_read < 0 && errno == EINTR ) {
+	  continue;
+	}
+	if( num_read <= 0 ) {
+	  close(pfd.fd);
+	  pfd.fd = -1;
+	  --open_pipes;
+	  continue;
+	}
+	buffers[p].append( readbuf, num_read );
+	drain_records( buffers[p], collected, collector );
+      }
+    }
+
+    bool all_ok = true;
+    for( pid_t child : children ) {
+      int status = 0;
+      pid_t waited;
+      do {
+	waited = waitpid( child, &status, 0 );
+      } while( waited < 0 && errno == EINTR );
+      if( waited < 0 || !WIFEXITED(status) ||
+	  WEXITSTATUS(status) != EXIT_SUCCESS ) {
+	all_ok = false;
+      }
+    }
+
+    // Stripes of workers that never started are run here instead
+    string result;
+    for( size_t item = 0 ; item < num_items ; ++item ) {
+      if( item % num_workers >= children.size() ) {
+	result.clear();
+	bool success = worker( item, result );
+	collected[item] = true;
+	collector( item, success, result );
+      }
+    }
+
+    // Anything a dead worker never got to is reported as a failure
+    for( size_t item = 0 ; item < num_items ; ++item ) {
+      if( !collected[item] ) {
+	all_ok = false;
+	collector( item, false, string() );
+      }
+    }
+
+    return all_ok;
+  }
+
+}
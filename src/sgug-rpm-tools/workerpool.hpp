@@ -0,0 +1,28 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <string>
+#include <functional>
+
+namespace sgug_rpm {
+
+  // Runs inside a forked worker; fills result with a serialized payload
+  typedef std::function<bool (size_t item, std::string & result)> forked_worker;
+  // Runs in the parent as each result streams back from a worker
+  typedef std::function<void (size_t item, bool success,
+			      const std::string & result)> forked_collector;
+
+  // librpm keeps global state (macro context, rpmdb handles) so
+  // parallelism is achieved with processes rather than threads.
+  // Items are striped across min(jobs, num_items) workers. With jobs <= 1
+  // everything runs in-process, as do the items of any worker that
+  // couldn't be started. Items whose worker died before reporting are
+  // collected as failures and the function returns false.
+  bool run_forked_pool( size_t num_items,
+			unsigned int jobs,
+			const forked_worker & worker,
+			const forked_collector & collector );
+
+}
+
+#endif